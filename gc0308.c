@@ -19,30 +19,153 @@
  */
 
 #include <linux/clk.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/device.h>
+#include <linux/gcd.h>
 #include <linux/i2c.h>
 #include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 #include <linux/pinctrl/consumer.h>
+#include <linux/pm_runtime.h>
+#include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
 #include <linux/v4l2-mediabus.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-ctrls.h>
 
-#define MIN_FPS 15
+#define CREATE_TRACE_POINTS
+#include <trace/events/gc0308.h>
+
+#include "gc0308_setting.h"
+
+#define MIN_FPS 1
 #define MAX_FPS 30
 #define DEFAULT_FPS 30
 
 #define GC0308_XCLK_MIN 6000000
 #define GC0308_XCLK_MAX 24000000
 
+#define GC0308_REG_CHIP_ID	0x00
+#define GC0308_REG_HB		0x01
+#define GC0308_REG_VB		0x02
+#define GC0308_REG_EXPOSURE_H	0x03
+#define GC0308_REG_ROW_START_H	0x05	/* 0x05-0x0c: row/col start, size */
+#define GC0308_REG_WIN_HEIGHT_H	0x09
+#define GC0308_REG_VB_HB_H	0x0f	/* [7:4] VB[11:8], [3:0] HB[11:8] */
+#define GC0308_REG_SH_DELAY	0x12
+#define GC0308_SH_DELAY_DEF	0x2a	/* as set by gc0308_default_setting */
+#define GC0308_REG_CISCTL_MODE1	0x14	/* [0] mirror, [1] upside down */
+#define GC0308_HFLIP		BIT(0)
+#define GC0308_VFLIP		BIT(1)
+#define GC0308_CISCTL_MODE1_DEF	0x11	/* as set by gc0308_default_setting */
+#define GC0308_REG_AAAA_EN	0x22	/* [1] AWB enable */
+#define GC0308_AWB_EN		BIT(1)
+#define GC0308_REG_SPECIAL_EFFECT	0x23
+#define GC0308_FX_NEGATIVE	BIT(0)
+#define GC0308_FX_FIXED_CBCR	BIT(1)	/* chroma from 0xba/0xbb */
+#define GC0308_REG_GLOBAL_GAIN	0x50	/* [5:0] */
+#define GC0308_GAIN_MAX		0x3f
+#define GC0308_REG_AWB_R_GAIN	0x5a	/* 0x5a-0x5c: R, G, B gains */
+#define GC0308_REG_DN_BILAT_B_BASE	0x62	/* denoise filter strength */
+#define GC0308_DENOISE_MAX	0x3f
+#define GC0308_REG_EDGE12_EFFECT	0x77	/* [7:4] edge1, [3:0] edge2 */
+#define GC0308_SHARPNESS_MAX	8
+#define GC0308_REG_GAMMA	0x9f	/* 0x9f-0xaf: RGB gamma curve */
+#define GC0308_GAMMA_POINTS	17
+#define GC0308_REG_AEC_MODE	0xd2	/* [7] AEC enable */
+#define GC0308_AEC_EN		BIT(7)
+#define GC0308_EXPOSURE_MAX	0xfff
+#define GC0308_REG_SATURATION_CB	0xb1
+#define GC0308_REG_CONTRAST	0xb3
+#define GC0308_REG_LUMA_OFFSET	0xb5
+#define GC0308_REG_FIXED_CB	0xba	/* 0xba Cb, 0xbb Cr */
+#define GC0308_REG_FLICKER_STEP_H	0xe2
+#define GC0308_REG_EXP_LEVEL1_H	0xe4	/* four levels, [11:8] then [7:0] */
+#define GC0308_REG_EXP_LEVEL_SEL	0xec	/* [5:4] top AEC level */
+#define GC0308_EXP_LEVEL_SEL_MASK	0x30
+#define GC0308_REG_OUTPUT_FMT	0x24
+#define GC0308_REG_CLK_DIV	0x28	/* [3:0] MCLK divider - 1 */
+#define GC0308_CLK_DIV_MAX	16
+#define GC0308_REG_DEBUG_MODE2	0x2e	/* [0] test image, [1] gradient */
+#define GC0308_TEST_IMAGE_EN	BIT(0)
+#define GC0308_TEST_IMAGE_GRADIENT	BIT(1)
+#define GC0308_REG_OUTPUT_EN	0x25
+#define GC0308_OUTPUT_EN_ALL	0x0f	/* data, HSYNC, VSYNC and PCLK pads */
+#define GC0308_REG_PAGE_SELECT	0xfe
+#define GC0308_SOFT_RESET	0x80
+#define GC0308_PAGE_MASK	0x01
+
+#define GC0308_PAGES		2
+#define GC0308_PAGE_REGS	0xfe	/* 0x00-0xfd, 0xfe selects the page */
+
+/*
+ * Paged registers are addressed as GC0308_REG(page, reg) in the regmap, which
+ * switches the hardware page through 0xfe on demand.
+ */
+#define GC0308_PAGE_BASE	0x100
+#define GC0308_REG(page, reg)	(GC0308_PAGE_BASE + ((page) << 8) + (reg))
+#define GC0308_MAX_REG		GC0308_REG(GC0308_PAGES - 1, 0xff)
+
+/*
+ * Pixel array as seen by crop rectangles. The window registers also cover
+ * the extra rows/columns the ISP consumes around the output (see 0x05-0x0c
+ * in the default table).
+ */
+#define GC0308_ARRAY_WIDTH	640
+#define GC0308_ARRAY_HEIGHT	480
+#define GC0308_WIN_PAD_W	8
+#define GC0308_WIN_PAD_H	8
+#define GC0308_CROP_MIN		16
+
+/* Blanking limits; HB_MIN is the shortest row used for 30 fps at 24 MHz */
+#define GC0308_HB_MIN		0x6a
+#define GC0308_HB_MAX		0xfff
+#define GC0308_VB_MAX		0xfff
+#define GC0308_EXP_LEVELS	4
+
+/*
+ * Manual exposure is latched at the start of the frame after the write and
+ * shows up in the one read out after that; gain is latched at the next frame
+ * start. While streaming every manual gain write is therefore staged one
+ * frame behind the exposure write, so exposure and gain changes, together or
+ * alone, show up GC0308_CTRL_LATENCY frames after the control is set.
+ */
+#define GC0308_CTRL_LATENCY	2
+
+/*
+ * Driver controls, in a block of 16 picked for this driver clear of the
+ * V4L2_CID_USER_*_BASE blocks in v4l2-controls.h. The block isn't reserved
+ * there, so the ID can be overridden if it ever clashes with one that is.
+ */
+#ifndef V4L2_CID_USER_GC0308_BASE
+#define V4L2_CID_USER_GC0308_BASE	(V4L2_CID_USER_BASE + 0x11f0)
+#endif
+#define V4L2_CID_GC0308_CTRL_LATENCY	(V4L2_CID_USER_GC0308_BASE + 0)
+#define V4L2_CID_GC0308_DENOISE		(V4L2_CID_USER_GC0308_BASE + 1)
+#define V4L2_CID_GC0308_MIN_FPS		(V4L2_CID_USER_GC0308_BASE + 2)
+
+/* Frames to wait after programming before the output is considered stable */
+#define GC0308_SETTLE_MIN_FRAMES	2
+#define GC0308_SETTLE_MAX_FRAMES	10
+/* ... and never longer than this, since the wait holds sensor->lock */
+#define GC0308_SETTLE_MAX_US	500000
+
 enum gc0308_mode {
 	gc0308_mode_MIN = 0,
 	gc0308_mode_VGA_640_480 = 0,
-	gc0308_mode_MAX = 1
+	gc0308_mode_QVGA_320_240 = 1,
+	gc0308_mode_QQVGA_160_120 = 2,
+	gc0308_mode_CIF_352_288 = 3,
+	gc0308_mode_MAX = 3
 };
 
 enum gc0308_frame_rate {
@@ -50,38 +173,113 @@ enum gc0308_frame_rate {
 	gc0308_30_fps
 };
 
-static int gc0308_framerates[] = {
-	[gc0308_15_fps] = 15,
-	[gc0308_30_fps] = 30,
-};
-
 struct gc0308_datafmt {
 	enum v4l2_mbus_pixelcode	code;
 	enum v4l2_colorspace		colorspace;
-};
-
-struct reg_value {
-	u8 u8RegAddr;
-	u8 u8Val;
+	u32				pixelformat;
+	u8				output_fmt;	/* 0x24 */
 };
 
 struct gc0308_mode_info {
 	enum gc0308_mode mode;
 	u32 width;
 	u32 height;
-	struct reg_value *init_data_ptr;
-	u32 init_data_size;
+	const u8 *init_data_ptr;
+	/* output size setup applied on top of init_data_ptr */
+	const u8 *mode_data_ptr;
+};
+
+struct gc0308_ctrls {
+	struct v4l2_ctrl_handler handler;
+	/* image cluster, written together */
+	struct {
+		struct v4l2_ctrl *brightness;
+		struct v4l2_ctrl *contrast;
+		struct v4l2_ctrl *saturation;
+	};
+	/* auto white balance cluster */
+	struct {
+		struct v4l2_ctrl *auto_wb;
+		struct v4l2_ctrl *red_balance;
+		struct v4l2_ctrl *blue_balance;
+	};
+	/* AEC drives exposure and gain together, so they form one cluster */
+	struct {
+		struct v4l2_ctrl *exposure_auto;
+		struct v4l2_ctrl *exposure;
+		struct v4l2_ctrl *autogain;
+		struct v4l2_ctrl *gain;
+	};
+	struct v4l2_ctrl *latency;
+	struct v4l2_ctrl *test_pattern;
+	/* readout direction, written together */
+	struct {
+		struct v4l2_ctrl *hflip;
+		struct v4l2_ctrl *vflip;
+	};
+	/* ISP stages */
+	struct v4l2_ctrl *sharpness;
+	struct v4l2_ctrl *gamma;
+	struct v4l2_ctrl *colorfx;
+	struct v4l2_ctrl *denoise;
+	/* AEC limits */
+	struct v4l2_ctrl *power_line;
+	struct v4l2_ctrl *min_fps;
+};
+
+/* I2C transfer latency histogram: bucket n counts [2^(n-1), 2^n) us */
+#define GC0308_LAT_BUCKETS	12
+
+enum gc0308_io_dir {
+	GC0308_IO_READ,
+	GC0308_IO_WRITE,
+	GC0308_IO_DIRS,
+};
+
+struct gc0308_io_stats {
+	u64 transfers;
+	u64 bytes;
+	u32 errors;
+	u32 latency[GC0308_LAT_BUCKETS];
+};
+
+/* where probe spent its time; regmap onwards may come from the init worker */
+struct gc0308_probe_timing {
+	s64 reset_us;
+	s64 chip_id_us;
+	s64 register_us;
+	s64 regmap_us;
+	s64 download_us;
+	s64 settle_us;
 };
 
 struct gc0308 {
 	struct v4l2_subdev		subdev;
 	struct i2c_client *i2c_client;
+	/*
+	 * Format state, updated under lock and state_lock. The query ops read
+	 * it under state_lock only, so they never wait for a table download.
+	 */
+	spinlock_t state_lock;
 	struct v4l2_pix_format pix;
 	const struct gc0308_datafmt	*fmt;
+	/* streamcap holds the frame interval programmed for frame_interval */
 	struct v4l2_captureparm streamcap;
+	struct v4l2_fract frame_interval;
+	enum gc0308_mode mode;
+	/* active array window, pix follows it */
+	struct v4l2_rect crop;
+	/* s_power(1) holds a runtime PM reference */
 	bool on;
+	bool streaming;
+	/*
+	 * Set by runtime resume: the sensor is powered but the register cache
+	 * hasn't been written back yet. Cleared by gc0308_pm_get().
+	 */
+	bool restore_pending;
 
 	/* control settings */
+	struct gc0308_ctrls ctrls;
 	int brightness;
 	int hue;
 	int contrast;
@@ -89,614 +287,106 @@ struct gc0308 {
 	int red;
 	int green;
 	int blue;
+	int auto_wb;
 	int ae_mode;
-
+	int autogain;
+	int exposure;
+	int gain;
+	int test_pattern;
+	int hflip;
+	int vflip;
+	int sharpness;
+	int gamma;
+	int colorfx;
+	int denoise;
+	int power_line;
+	int min_fps;
+
+	/* MCLK as actually provided by the clock, not as requested */
 	u32 mclk;
 	u8 mclk_source;
+	/* fastest PCLK the CSI accepts, 0 if the DT doesn't limit it */
+	u32 pclk_max;
+	/* MCLK divider, and the array clock it leaves (MCLK / 2 / clk_div) */
+	u32 clk_div;
+	u32 sys_clk;
 	struct clk *sensor_clk;
 	int csi;
 
-	void (*io_init)(void);
+	struct regmap *regmap;
+	/* power-on register file, seeds the regmap cache */
+	struct reg_default reg_defaults[GC0308_PAGES * GC0308_PAGE_REGS];
+
+	/* time the last gc0308_init_mode() waited for the output to settle */
+	u32 settle_us;
+
+	/*
+	 * Serialises every register sequence (table downloads with their page
+	 * selects, timing and control updates) between the deferred init
+	 * worker, the subdev ops and the control handler.
+	 */
+	struct mutex lock;
+	struct work_struct init_work;
+	/* staged manual gain write, see gc0308_write_aec() */
+	struct delayed_work gain_work;
+	/* completed once init_err holds the result of gc0308_hw_init() */
+	struct completion init_done;
+	int init_err;
+
+	int pwn_gpio;
+	int rst_gpio;
+
+	/* bus traffic, counted in the regmap bus callbacks */
+	struct gc0308_io_stats io_stats[GC0308_IO_DIRS];
+	/* page last selected on the bus, for the register I/O tracepoints */
+	u8 bus_page;
+	struct gc0308_probe_timing probe_timing;
+	struct dentry *debugfs;
+	/* page the debugfs register file dumps and pokes */
+	u8 debugfs_page;
+
+	void (*io_init)(struct gc0308 *sensor);
 };
 
-/*!
- * Maintains the information on the current state of the sesor.
- */
-static struct gc0308 gc0308_data;
-static int pwn_gpio, rst_gpio;
-
-static struct reg_value gc0308_setting_30fps_VGA_640_480[] = {
-
-    {0xfe,0x80},
-    {0xfe,0x00},
-    {0x22,0x55},
-    {0x03,0x02},
-    {0x04,0x58},//12c
-    {0x5a,0x56},
-    {0x5b,0x40},
-    {0x5c,0x4a},
-    {0x22,0x57},
-
-   // 50hz   24M MCLKauto
-    {0x01 , 0x6a},  //32
-    {0x02 , 0x70},
-    {0x0f , 0x01},
-
-    {0xe2 , 0x00},   //anti-flicker step [11:8]
-    {0xe3 , 0x78},   //anti-flicker step [7:0]
-
-    {0xe4 , 0x02},
-    {0xe5 , 0x58},
-    {0xe6 , 0x03},
-    {0xe7 , 0x48},
-    {0xe8 , 0x04},
-    {0xe9 , 0xb0},
-    {0xea , 0x05},
-    {0xeb , 0xa0},
-
-    {0x05,0x00},
-    {0x06,0x00},
-    {0x07,0x00},
-    {0x08,0x02},
-    {0x09,0x01},
-    {0x0a,0xea},// ea
-    {0x0b,0x02},
-    {0x0c,0x88},
-    {0x0d,0x02},
-    {0x0e,0x02},
-    {0x10,0x26},
-    {0x11,0x0d},
-    {0x12,0x2a},
-    {0x13,0x00},
-    {0x14,0x13}, //10 // h_v need mirror for preview
-    {0x15,0x0a},
-    {0x16,0x05},
-    {0x17,0x01},
-    {0x18,0x44},
-    {0x19,0x44},
-    {0x1a,0x2a},
-    {0x1b,0x00},
-    {0x1c,0x49},
-    {0x1d,0x9a},
-    {0x1e,0x61},
-    {0x1f,0x16},
-    {0x20,0xff},//ff
-    {0x21,0xf8},//fa
-    {0x22,0x57},
-    {0x24,0xa2},    // output format
-    {0x25,0x0f},
-#ifdef CONFIG_ARCH_MESON3
-    {0x26,0x01}, //03
-#else
-    {0x26,0x03}, //03
-#endif
-    {0x2f,0x01},
-    {0x30,0xf7},
-    {0x31,0x50},
-    {0x32,0x00},
-    {0x39,0x04},
-    {0x3a,0x20},
-    {0x3b,0x20},
-    {0x3c,0x02},
-    {0x3d,0x02}, //0x00
-    {0x3e,0x02},
-    {0x3f,0x02},
-    {0x50,0x14}, // 0x14
-    {0x53,0x80},
-    {0x54,0x87},
-    {0x55,0x87},
-    {0x56,0x80},
-
-    {0x57,0x7a},// r ratio
-    {0x58,0x7e},// g ratio
-    {0x59,0x84},//b ratio
-
-    {0x8b,0x10},
-    {0x8c,0x10},
-    {0x8d,0x10},
-    {0x8e,0x10},
-    {0x8f,0x10},
-    {0x90,0x10},
-    {0x91,0x3c},
-    {0x92,0x50},
-    {0x5d,0x12},
-    {0x5e,0x1a},
-    {0x5f,0x24},
-    {0x60,0x07},
-    {0x61,0x15},
-    {0x62,0x08}, // 0x08
-    {0x64,0x03},  // 0x03
-    {0x66,0xe8},
-    {0x67,0x86},
-    {0x68,0xa2},
-    {0x69,0x18},
-    {0x6a,0x0f},
-    {0x6b,0x00},
-    {0x6c,0x5f},
-    {0x6d,0x8f},
-    {0x6e,0x55},
-    {0x6f,0x38},
-    {0x70,0x15},
-    {0x71,0x33}, // low light startion
-    {0x72,0xdc},
-    {0x73,0x80},
-    {0x74,0x02},
-    {0x75,0x3f},
-    {0x76,0x02},
-    {0x77,0x45}, // 0x47 //0x54
-    {0x78,0x88},
-    {0x79,0x81},
-    {0x7a,0x81},
-    {0x7b,0x22},
-    {0x7c,0xff},
-///////CC/////
-    {0x93,0x42},  //0x48
-    {0x94,0x00},
-    {0x95,0x0c},//04
-    {0x96,0xe0},
-    {0x97,0x46},
-    {0x98,0xf3},
-
-    {0xb1,0x40},// startion
-    {0xb2,0x40},
-    {0xb3,0x3c}, //0x40  contrast
-    {0xb5,0x00}, //
-    {0xb6,0xe0},
-    {0xbd,0x3C},
-    {0xbe,0x36},
-    {0xd0,0xCb},//c9
-    {0xd1,0x10},
-    {0xd2,0x90},
-    {0xd3,0x50},//88
-    {0xd5,0xF2},
-    {0xd6,0x10},
-    {0xdb,0x92},
-    {0xdc,0xA5},
-    {0xdf,0x23},
-    {0xd9,0x00},
-    {0xda,0x00},
-    {0xe0,0x09},
-    {0xed,0x04},
-    {0xee,0xa0},
-    {0xef,0x40},
-    {0x80,0x03},
-
-    {0x9F, 0x10},//     case 3:
-    {0xA0, 0x20},
-    {0xA1, 0x38},
-    {0xA2, 0x4E},
-    {0xA3, 0x63},
-    {0xA4, 0x76},
-    {0xA5, 0x87},
-    {0xA6, 0xA2},
-    {0xA7, 0xB8},
-    {0xA8, 0xCA},
-    {0xA9, 0xD8},
-    {0xAA, 0xE3},
-    {0xAB, 0xEB},
-    {0xAC, 0xF0},
-    {0xAD, 0xF8},
-    {0xAE, 0xFD},
-    {0xAF, 0xFF},
-
-    {0xc0,0x00},
-    {0xc1,0x14},
-    {0xc2,0x21},
-    {0xc3,0x36},
-    {0xc4,0x49},
-    {0xc5,0x5B},
-    {0xc6,0x6B},
-    {0xc7,0x7B},
-    {0xc8,0x98},
-    {0xc9,0xB4},
-    {0xca,0xCE},
-    {0xcb,0xE8},
-    {0xcc,0xFF},
-    {0xf0,0x02},
-    {0xf1,0x01},
-    {0xf2,0x01},
-    {0xf3,0x30},
-    {0xf9,0x9f},
-    {0xfa,0x78},
-    {0xfe,0x01},
-    {0x00,0xf5},
-    {0x02,0x20},
-    {0x04,0x10},
-    {0x05,0x10},
-    {0x06,0x20},
-    {0x08,0x15},
-    {0x0a,0xa0},
-    {0x0b,0x64},
-    {0x0c,0x08},
-    {0x0e,0x4C},
-    {0x0f,0x39},
-    {0x10,0x41},
-    {0x11,0x37},
-    {0x12,0x24},
-    {0x13,0x39},
-    {0x14,0x45},
-    {0x15,0x45},
-    {0x16,0xc2},
-    {0x17,0xA8},
-    {0x18,0x18},
-    {0x19,0x55},
-    {0x1a,0xd8},
-    {0x1b,0xf5},
-
-    {0x1c,0x60}, //r gain limit
-
-    {0x70,0x40},
-    {0x71,0x58},
-    {0x72,0x30},
-    {0x73,0x48},
-    {0x74,0x20},
-    {0x75,0x60},
-    {0x77,0x20},
-    {0x78,0x32},
-    {0x30,0x03},
-    {0x31,0x40},
-    {0x32,0x10},
-    {0x33,0xe0},
-    {0x34,0xe0},
-    {0x35,0x00},
-    {0x36,0x80},
-    {0x37,0x00},
-    {0x38,0x04},
-    {0x39,0x09},
-    {0x3a,0x12},
-    {0x3b,0x1C},
-    {0x3c,0x28},
-    {0x3d,0x31},
-    {0x3e,0x44},
-    {0x3f,0x57},
-    {0x40,0x6C},
-    {0x41,0x81},
-    {0x42,0x94},
-    {0x43,0xA7},
-    {0x44,0xB8},
-    {0x45,0xD6},
-    {0x46,0xEE},
-    {0x47,0x0d},
-    {0xfe, 0x00},// update
-
-    {0x10, 0x26},
-    {0x11, 0x0d},  // fd,modified by mormo 2010/07/06
-    {0x1a, 0x2a},  // 1e,modified by mormo 2010/07/06
-
-    {0x1c, 0x49}, // c1,modified by mormo 2010/07/06
-    {0x1d, 0x9a}, // 08,modified by mormo 2010/07/06
-    {0x1e, 0x61}, // 60,modified by mormo 2010/07/06
-
-    {0x3a, 0x20},
-
-    {0x50, 0x14},  // 10,modified by mormo 2010/07/06
-    {0x53, 0x80},
-    {0x56, 0x80},
-
-    {0x8b, 0x20}, //LSC
-    {0x8c, 0x20},
-    {0x8d, 0x20},
-    {0x8e, 0x14},
-    {0x8f, 0x10},
-    {0x90, 0x14},
-
-    {0x94, 0x02},
-    {0x95, 0x0c}, //0x07
-    {0x96, 0xe0},
-
-    {0xb1, 0x40}, // YCPT
-    {0xb2, 0x40},
-    {0xb3, 0x3c},
-    {0xb6, 0xe0},
-
-    {0xd0, 0xcb}, // AECT  c9,modifed by mormo 2010/07/06
-    {0xd3, 0x50}, // 80,modified by mormor 2010/07/06   58
-
-    {0xf2, 0x02},
-    {0xf7, 0x12},
-    {0xf8, 0x0a},
-    //Regsters of Page1
-    {0xfe, 0x01},
-
-    {0x02, 0x20},
-    {0x04, 0x10},
-    {0x05, 0x08},
-    {0x06, 0x20},
-    {0x08, 0x0a},
-
-    {0x0e, 0x44},
-    {0x0f, 0x32},
-    {0x10, 0x41},
-    {0x11, 0x37},
-    {0x12, 0x22},
-    {0x13, 0x19},
-    {0x14, 0x44},
-    {0x15, 0x44},
-
-    {0x19, 0x50},
-    {0x1a, 0xd8},
-
-    {0x32, 0x10},
-
-    {0x35, 0x00},
-    {0x36, 0x80},
-    {0x37, 0x00},
-    //-----------Update the registers end---------//
-    {0xfe, 0x00},
-    {0xfe, 0x00},
-    {0xff, 0xff},
+static bool burst_download = true;
+module_param(burst_download, bool, 0644);
+MODULE_PARM_DESC(burst_download,
+	"Download register tables as burst I2C writes (0 = one write per register)");
 
-};
+static int autosuspend_delay_ms = 1000;
+module_param(autosuspend_delay_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_delay_ms,
+	"Idle time before the sensor is powered down (ms, -1 = never)");
 
-static struct reg_value gc0308_default_setting[] = {
-    {0xfe,0x00},
-    //MCLK=24MHz 10fps
-    {0x0f,0x05},     //0x00                                        
-    {0x01,0xe1},   //0x6a                                        
-    {0x02,0x70},   //0x70                                        
-    {0xe2,0x00},
-    {0xe3,0x96},
-    {0xe4,0x02},
-    {0xe5,0x58},
-    {0xe6,0x02},
-    {0xe7,0x58},
-    {0xe8,0x02},
-    {0xe9,0x58},
-    {0xea,0x0e},
-    {0xeb,0xa6},
-    {0xfe,0x00},                                    
-    {0xec,0x20},                                           
-    {0x05,0x00},                                           
-    {0x06,0x00},                                           
-    {0x07,0x00},                                           
-    {0x08,0x00},                                           
-    {0x09,0x01},                                           
-    {0x0a,0xe8},                                           
-    {0x0b,0x02},                                           
-    {0x0c,0x88},                                           
-    {0x0d,0x02},                                           
-    {0x0e,0x02},                                           
-    {0x10,0x26},                                           
-    {0x11,0x0d},                                           
-    {0x12,0x2a},                                           
-    {0x13,0x00},                                           
-    {0x14,0x11},                                           
-    {0x15,0x0a},                                           
-    {0x16,0x05},                                           
-    {0x17,0x01},                                           
-    {0x18,0x44},                                           
-    {0x19,0x44},                                           
-    {0x1a,0x2a},                                           
-    {0x1b,0x00},                                           
-    {0x1c,0x49},                                           
-    {0x1d,0x9a},                                           
-    {0x1e,0x61},                                           
-    {0x1f,0x00},  //pad drv <=24MHz, use 0x00 is ok
-    {0x20,0x7f},                                           
-    {0x21,0xfa},                                           
-    {0x22,0x57},                                           
-    {0x24,0xa2},    //YCbYCr                                 
-    {0x25,0x0f},                                           
-    {0x26,0x03}, // 0x01        
-    {0x28,0x00},       
-    {0x2d,0x0a},                      
-    {0x2f,0x01},                                           
-    {0x30,0xf7},                                           
-    {0x31,0x50},                                           
-    {0x32,0x00},   
-    {0x33,0x28},    
-    {0x34,0x2a},    
-    {0x35,0x28},                                            
-    {0x39,0x04},                                           
-    {0x3a,0x20},                                           
-    {0x3b,0x20},                                           
-    {0x3c,0x00},                                           
-    {0x3d,0x00},                                           
-    {0x3e,0x00},                                           
-    {0x3f,0x00},                                           
-    {0x50,0x14}, // 0x14  
-    {0x52,0x41},                                  
-    {0x53,0x80},                                           
-    {0x54,0x80},                                           
-    {0x55,0x80},                                           
-    {0x56,0x80},                                           
-    {0x8b,0x20},                                           
-    {0x8c,0x20},                                           
-    {0x8d,0x20},                                           
-    {0x8e,0x14},                                           
-    {0x8f,0x10},                                           
-    {0x90,0x14},                                           
-    {0x91,0x3c},                                           
-    {0x92,0x50},   
-    //{0x8b,0x10},                                           
-    //{0x8c,0x10},                                           
-    //{0x8d,0x10},                                           
-    //{0x8e,0x10},                                           
-    //{0x8f,0x10},                                           
-    //{0x90,0x10},                                           
-    //{0x91,0x3c},                                           
-    //{0x92,0x50},                                         
-    {0x5d,0x12},                                           
-    {0x5e,0x1a},                                           
-    {0x5f,0x24},                                           
-    {0x60,0x07},                                           
-    {0x61,0x15},                                           
-    {0x62,0x08}, // 0x08                                   
-    {0x64,0x03},  // 0x03                                  
-    {0x66,0xe8},                                           
-    {0x67,0x86},                                           
-    {0x68,0x82},                                           
-    {0x69,0x18},                                           
-    {0x6a,0x0f},                                           
-    {0x6b,0x00},                                           
-    {0x6c,0x5f},                                           
-    {0x6d,0x8f},                                           
-    {0x6e,0x55},                                           
-    {0x6f,0x38},                                           
-    {0x70,0x15},                                           
-    {0x71,0x33},                                           
-    {0x72,0xdc},                                           
-    {0x73,0x00},                                           
-    {0x74,0x02},                                           
-    {0x75,0x3f},                                           
-    {0x76,0x02},                                           
-    {0x77,0x38}, // 0x47                                   
-    {0x78,0x88},                                           
-    {0x79,0x81},                                           
-    {0x7a,0x81},                                           
-    {0x7b,0x22},                                           
-    {0x7c,0xff},                                          
-    {0x93,0x48},  //color matrix default                                          
-    {0x94,0x02},                                           
-    {0x95,0x07},                                           
-    {0x96,0xe0},                                           
-    {0x97,0x40},                                           
-    {0x98,0xf0},                                     
-    {0xb1,0x40},                                           
-    {0xb2,0x40},                                           
-    {0xb3,0x40}, //0x40                                    
-    {0xb6,0xe0},                                           
-    {0xbd,0x38},                                           
-    {0xbe,0x36},                                           
-    {0xd0,0xCB},                                           
-    {0xd1,0x10},                                           
-    {0xd2,0x90},                                           
-    {0xd3,0x48},                                           
-    {0xd5,0xF2},                                           
-    {0xd6,0x16},                                           
-    {0xdb,0x92},                                           
-    {0xdc,0xA5},                                           
-    {0xdf,0x23},                                           
-    {0xd9,0x00},                                           
-    {0xda,0x00},                                           
-    {0xe0,0x09},                                           
-    {0xed,0x04},                                           
-    {0xee,0xa0},                                           
-    {0xef,0x40},                                           
-    {0x80,0x03},                                           
-                                                              
-    {0x9F,0x10},                                           
-    {0xA0,0x20},                                           
-    {0xA1,0x38},                                           
-    {0xA2,0x4e},                                           
-    {0xA3,0x63},                                           
-    {0xA4,0x76},                                           
-    {0xA5,0x87},                                           
-    {0xA6,0xa2},                                           
-    {0xA7,0xb8},                                           
-    {0xA8,0xca},                                           
-    {0xA9,0xd8},                                           
-    {0xAA,0xe3},                                           
-    {0xAB,0xeb},                                           
-    {0xAC,0xf0},                                           
-    {0xAD,0xF8},                                           
-    {0xAE,0xFd},                                           
-    {0xAF,0xFF},                                                     
-                                                               
-    {0xc0,0x00},                                           
-    {0xc1,0x10},                                           
-    {0xc2,0x1c},                                           
-    {0xc3,0x30},                                           
-    {0xc4,0x43},                                           
-    {0xc5,0x54},                                           
-    {0xc6,0x65},                                           
-    {0xc7,0x75},                                           
-    {0xc8,0x93},                                           
-    {0xc9,0xB0},                                           
-    {0xca,0xCB},                                           
-    {0xcb,0xE6},                                           
-    {0xcc,0xFF},                                           
-    {0xf0,0x02},                                           
-    {0xf1,0x01},                                           
-    {0xf2,0x02},                                           
-    {0xf3,0x30},     
-    {0xf7,0x12}, 
-    {0xf8,0x0a},                                       
-    {0xf9,0x9f},                                           
-    {0xfa,0x78},                                           
-    {0xfe,0x01},                                           
-    {0x00,0xf5},                                           
-    {0x02,0x20},                                           
-    {0x04,0x10},                                           
-    {0x05,0x08},                                           
-    {0x06,0x20},                                           
-    {0x08,0x0a},                                           
-    {0x0a,0xa0},                                           
-    {0x0b,0x60},                                           
-    {0x0c,0x08},                                           
-    {0x0e,0x44},                                           
-    {0x0f,0x32},                                           
-    {0x10,0x41},                                           
-    {0x11,0x37},                                           
-    {0x12,0x22},                                           
-    {0x13,0x19},                                           
-    {0x14,0x44},                                           
-    {0x15,0x44},                                           
-    {0x16,0xc2},                                           
-    {0x17,0xA8},                                           
-    {0x18,0x18},                                           
-    {0x19,0x50},                                           
-    {0x1a,0xd8},                                           
-    {0x1b,0xf5},                                           
-    {0x70,0x40},                                           
-    {0x71,0x58},                                           
-    {0x72,0x30},                                           
-    {0x73,0x48},                                           
-    {0x74,0x20},                                           
-    {0x75,0x60},                                           
-    {0x77,0x20},                                           
-    {0x78,0x32},                                           
-    {0x30,0x03},                                           
-    {0x31,0x40},                                           
-    {0x32,0x10},                                           
-    {0x33,0xe0},                                           
-    {0x34,0xe0},                                           
-    {0x35,0x00},                                           
-    {0x36,0x80},                                           
-    {0x37,0x00},                                           
-    {0x38,0x04},                                           
-    {0x39,0x09},                                           
-    {0x3a,0x12},                                           
-    {0x3b,0x1C},                                           
-    {0x3c,0x28},                                           
-    {0x3d,0x31},                                           
-    {0x3e,0x44},                                           
-    {0x3f,0x57},                                           
-    {0x40,0x6C},                                           
-    {0x41,0x81},                                           
-    {0x42,0x94},                                           
-    {0x43,0xA7},                                           
-    {0x44,0xB8},                                           
-    {0x45,0xD6},                                           
-    {0x46,0xEE},                                           
-    {0x47,0x0d},   
-    {0x62,0xf7},
-    {0x63,0x68},
-    {0x64,0xd3},
-    {0x65,0xd3},
-    {0x66,0x60},
-    {0xfe,0x00},              
-};
+static bool async_init = true;
+module_param(async_init, bool, 0444);
+MODULE_PARM_DESC(async_init,
+	"Program the sensor from a worker after probe (0 = during probe)");
+
+#define GC0308_MODE(m, w, h, setting)				\
+	{gc0308_mode_##m, w, h, gc0308_default_setting, setting}
 
 static struct gc0308_mode_info gc0308_mode_info_data[2][gc0308_mode_MAX + 1] = {
     {
-        {gc0308_mode_VGA_640_480, 640, 480, 
-         gc0308_default_setting, 
-         ARRAY_SIZE(gc0308_default_setting)},
+        GC0308_MODE(VGA_640_480, 640, 480, gc0308_setting_VGA_640_480),
+        GC0308_MODE(QVGA_320_240, 320, 240, gc0308_setting_QVGA_320_240),
+        GC0308_MODE(QQVGA_160_120, 160, 120, gc0308_setting_QQVGA_160_120),
+        GC0308_MODE(CIF_352_288, 352, 288, gc0308_setting_CIF_352_288),
     },
     {
-        {gc0308_mode_VGA_640_480, 640, 480, 
-         gc0308_default_setting, 
-         ARRAY_SIZE(gc0308_default_setting)},
+        GC0308_MODE(VGA_640_480, 640, 480, gc0308_setting_VGA_640_480),
+        GC0308_MODE(QVGA_320_240, 320, 240, gc0308_setting_QVGA_320_240),
+        GC0308_MODE(QQVGA_160_120, 160, 120, gc0308_setting_QQVGA_160_120),
+        GC0308_MODE(CIF_352_288, 352, 288, gc0308_setting_CIF_352_288),
     },
 };
 
 static int gc0308_probe(struct i2c_client *adapter,
 				const struct i2c_device_id *device_id);
 static int gc0308_remove(struct i2c_client *client);
+static const struct dev_pm_ops gc0308_pm_ops;
 
-static s32 gc0308_read_reg(u8 reg, u8 *val);
-static s32 gc0308_write_reg(u8 reg, u8 val);
+static s32 gc0308_read_reg(struct gc0308 *sensor, u8 reg, u8 *val);
 
 static const struct i2c_device_id gc0308_id[] = {
 	{"gc0308", 0},
@@ -709,6 +399,7 @@ static struct i2c_driver gc0308_i2c_driver = {
 	.driver = {
 		  .owner = THIS_MODULE,
 		  .name  = "gc0308",
+		  .pm    = &gc0308_pm_ops,
 		  },
 	.probe  = gc0308_probe,
 	.remove = gc0308_remove,
@@ -716,7 +407,15 @@ static struct i2c_driver gc0308_i2c_driver = {
 };
 
 static const struct gc0308_datafmt gc0308_colour_fmts[] = {
-	{V4L2_MBUS_FMT_YUYV8_2X8, V4L2_COLORSPACE_JPEG},
+	{V4L2_MBUS_FMT_YUYV8_2X8, V4L2_COLORSPACE_JPEG,
+	 V4L2_PIX_FMT_YUYV, 0xa2},
+	{V4L2_MBUS_FMT_UYVY8_2X8, V4L2_COLORSPACE_JPEG,
+	 V4L2_PIX_FMT_UYVY, 0xa0},
+	{V4L2_MBUS_FMT_RGB565_2X8_BE, V4L2_COLORSPACE_SRGB,
+	 V4L2_PIX_FMT_RGB565X, 0xa6},
+	/* luma only, one byte per pixel */
+	{V4L2_MBUS_FMT_Y8_1X8, V4L2_COLORSPACE_JPEG,
+	 V4L2_PIX_FMT_GREY, 0xb1},
 };
 
 static struct gc0308 *to_gc0308(const struct i2c_client *client)
@@ -737,111 +436,1178 @@ static const struct gc0308_datafmt
 	return NULL;
 }
 
-static inline void gc0308_power_down(int enable)
+static const struct gc0308_datafmt *gc0308_find_pixfmt(u32 pixelformat)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(gc0308_colour_fmts); i++)
+		if (gc0308_colour_fmts[i].pixelformat == pixelformat)
+			return gc0308_colour_fmts + i;
+
+	return NULL;
+}
+
+/* Registers the sensor updates on its own (AEC exposure and gain, AWB) */
+static const struct regmap_range gc0308_volatile_ranges[] = {
+	regmap_reg_range(GC0308_REG(0, 0x03), GC0308_REG(0, 0x04)),
+	regmap_reg_range(GC0308_REG(0, 0x50), GC0308_REG(0, 0x50)),
+	regmap_reg_range(GC0308_REG(0, 0x5a), GC0308_REG(0, 0x5c)),
+};
+
+static const struct regmap_access_table gc0308_volatile_table = {
+	.yes_ranges = gc0308_volatile_ranges,
+	.n_yes_ranges = ARRAY_SIZE(gc0308_volatile_ranges),
+};
+
+/* Only the page selector and the paged aliases are ever accessed */
+static const struct regmap_range gc0308_access_ranges[] = {
+	regmap_reg_range(GC0308_REG_PAGE_SELECT, GC0308_REG_PAGE_SELECT),
+	regmap_reg_range(GC0308_REG(0, 0x00), GC0308_REG(0, 0xfd)),
+	regmap_reg_range(GC0308_REG(1, 0x00), GC0308_REG(1, 0xfd)),
+};
+
+static const struct regmap_access_table gc0308_access_table = {
+	.yes_ranges = gc0308_access_ranges,
+	.n_yes_ranges = ARRAY_SIZE(gc0308_access_ranges),
+};
+
+static const struct regmap_range_cfg gc0308_regmap_ranges[] = {
+	{
+		.name = "gc0308-pages",
+		.range_min = GC0308_REG(0, 0x00),
+		.range_max = GC0308_MAX_REG,
+		.selector_reg = GC0308_REG_PAGE_SELECT,
+		.selector_mask = GC0308_PAGE_MASK,
+		.selector_shift = 0,
+		.window_start = 0,
+		.window_len = 0x100,
+	},
+};
+
+static const struct regmap_config gc0308_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.max_register = GC0308_MAX_REG,
+	.wr_table = &gc0308_access_table,
+	.rd_table = &gc0308_access_table,
+	.volatile_table = &gc0308_volatile_table,
+	.ranges = gc0308_regmap_ranges,
+	.num_ranges = ARRAY_SIZE(gc0308_regmap_ranges),
+	.cache_type = REGCACHE_RBTREE,
+};
+
+static bool gc0308_reg_volatile(unsigned int reg)
 {
-	gpio_set_value_cansleep(pwn_gpio, enable);
+	return regmap_reg_in_ranges(reg, gc0308_volatile_ranges,
+				    ARRAY_SIZE(gc0308_volatile_ranges));
+}
+
+static void gc0308_io_account(struct gc0308 *sensor, enum gc0308_io_dir dir,
+			      s64 duration_ns, int len, int ret)
+{
+	struct gc0308_io_stats *stats = &sensor->io_stats[dir];
+	u32 us = div_s64(duration_ns, NSEC_PER_USEC);
+
+	stats->transfers++;
+	if (ret < 0)
+		stats->errors++;
+	else
+		stats->bytes += len;
+	stats->latency[min_t(int, fls(us), GC0308_LAT_BUCKETS - 1)]++;
+}
+
+/*
+ * Read registers straight from the bus: the address write and the data
+ * read form one transfer joined by a repeated start, so no other master
+ * can get in between.
+ */
+static int gc0308_i2c_read(struct gc0308 *sensor, u8 reg, u8 *buf, int len)
+{
+	struct i2c_client *client = sensor->i2c_client;
+	struct i2c_msg msgs[2] = {
+		{
+			.addr = client->addr,
+			.flags = 0,
+			.len = 1,
+			.buf = &reg,
+		}, {
+			.addr = client->addr,
+			.flags = I2C_M_RD,
+			.len = len,
+			.buf = buf,
+		},
+	};
+	ktime_t start = ktime_get();
+	s64 duration_ns;
+	int ret;
+
+	ret = i2c_transfer(client->adapter, msgs, ARRAY_SIZE(msgs));
+	if (ret >= 0 && ret != ARRAY_SIZE(msgs))
+		ret = -EIO;
+
+	duration_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	gc0308_io_account(sensor, GC0308_IO_READ, duration_ns, len, ret);
+	trace_gc0308_reg_read(&client->dev, sensor->bus_page, reg, buf, len,
+			      ret, duration_ns);
+
+	return ret < 0 ? ret : 0;
+}
+
+/* Write buf[1..] to the registers starting at buf[0] */
+static int gc0308_i2c_write(struct gc0308 *sensor, const u8 *buf, int len)
+{
+	struct i2c_client *client = sensor->i2c_client;
+	ktime_t start = ktime_get();
+	s64 duration_ns;
+	int ret;
+
+	ret = i2c_master_send(client, buf, len);
+	if (ret >= 0 && ret != len)
+		ret = -EIO;
+
+	duration_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	gc0308_io_account(sensor, GC0308_IO_WRITE, duration_ns, len - 1, ret);
+	trace_gc0308_reg_write(&client->dev, sensor->bus_page, buf[0],
+			       buf + 1, len - 1, ret, duration_ns);
+
+	if (ret >= 0 && buf[0] == GC0308_REG_PAGE_SELECT && len > 1)
+		sensor->bus_page = buf[1] & GC0308_PAGE_MASK;
+
+	return ret < 0 ? ret : 0;
+}
+
+static int gc0308_regmap_bus_write(void *context, const void *data,
+				   size_t count)
+{
+	return gc0308_i2c_write(context, data, count);
+}
+
+static int gc0308_regmap_bus_read(void *context, const void *reg_buf,
+				  size_t reg_size, void *val_buf,
+				  size_t val_size)
+{
+	if (reg_size != 1)
+		return -EINVAL;
+
+	return gc0308_i2c_read(context, *(const u8 *)reg_buf, val_buf,
+			       val_size);
+}
+
+/*
+ * Plain I2C, as regmap_init_i2c() would set up, routed through the two
+ * helpers above so that every transfer shows up in the debugfs stats.
+ */
+static const struct regmap_bus gc0308_regmap_bus = {
+	.write = gc0308_regmap_bus_write,
+	.read = gc0308_regmap_bus_read,
+};
+
+/*
+ * Create the register map. The cache is seeded with the register file as
+ * read back from the freshly reset sensor, so that regcache_sync() only
+ * has to write registers that differ from the hardware defaults.
+ */
+static int gc0308_regmap_init(struct gc0308 *sensor)
+{
+	struct i2c_client *client = sensor->i2c_client;
+	struct regmap_config config = gc0308_regmap_config;
+	struct reg_default *def = sensor->reg_defaults;
+	struct regmap *map;
+	u8 vals[GC0308_PAGE_REGS];
+	int page, reg, ret = 0;
+
+	config.cache_type = REGCACHE_NONE;
+	map = regmap_init(&client->dev, &gc0308_regmap_bus, sensor, &config);
+	if (IS_ERR(map))
+		return PTR_ERR(map);
+
+	for (page = 0; page < GC0308_PAGES; page++) {
+		ret = regmap_bulk_read(map, GC0308_REG(page, 0x00), vals,
+				       GC0308_PAGE_REGS);
+		if (ret < 0)
+			break;
+
+		for (reg = 0; reg < GC0308_PAGE_REGS; reg++) {
+			if (gc0308_reg_volatile(GC0308_REG(page, reg)))
+				continue;
+			def->reg = GC0308_REG(page, reg);
+			def->def = vals[reg];
+			def++;
+		}
+	}
+	regmap_exit(map);
+	if (ret < 0) {
+		dev_err(&client->dev, "reading register defaults failed\n");
+		return ret;
+	}
+
+	config = gc0308_regmap_config;
+	config.reg_defaults = sensor->reg_defaults;
+	config.num_reg_defaults = def - sensor->reg_defaults;
+	map = devm_regmap_init(&client->dev, &gc0308_regmap_bus, sensor,
+			       &config);
+	if (IS_ERR(map))
+		return PTR_ERR(map);
+
+	sensor->regmap = map;
+
+	return 0;
+}
+
+/*
+ * Forget the cached page selector. regcache_sync() and the debugfs register
+ * dump switch pages with the cache bypassed, so afterwards the cached 0xfe
+ * may name the wrong page; without it, the next paged access reads the
+ * page back from the sensor.
+ */
+static void gc0308_drop_page_cache(struct gc0308 *sensor)
+{
+	regcache_drop_region(sensor->regmap, GC0308_REG_PAGE_SELECT,
+			     GC0308_REG_PAGE_SELECT);
+}
+
+static inline void gc0308_power_down(struct gc0308 *sensor, int enable)
+{
+	trace_gc0308_power_down(&sensor->i2c_client->dev, enable);
+	gpio_set_value_cansleep(sensor->pwn_gpio, enable);
 
 	msleep(2);
 }
 
-static inline void gc0308_reset(void)
+static inline void gc0308_reset(struct gc0308 *sensor)
 {
+	trace_gc0308_reset(&sensor->i2c_client->dev, 1);
+
 	/* camera reset */
-	gpio_set_value_cansleep(rst_gpio, 1);
+	gpio_set_value_cansleep(sensor->rst_gpio, 1);
 
 	/* camera power down */
-	gpio_set_value_cansleep(pwn_gpio, 1);
+	gpio_set_value_cansleep(sensor->pwn_gpio, 1);
 	msleep(5);
-	gpio_set_value_cansleep(pwn_gpio, 0);
+	gpio_set_value_cansleep(sensor->pwn_gpio, 0);
 	msleep(5);
-	gpio_set_value_cansleep(rst_gpio, 0);
+	gpio_set_value_cansleep(sensor->rst_gpio, 0);
 	msleep(1);
-	gpio_set_value_cansleep(rst_gpio, 1);
+	gpio_set_value_cansleep(sensor->rst_gpio, 1);
 	msleep(5);
-	gpio_set_value_cansleep(pwn_gpio, 1);
+	gpio_set_value_cansleep(sensor->pwn_gpio, 1);
+
+	/* a reset sensor comes up on page 0 */
+	sensor->bus_page = 0;
+	trace_gc0308_reset(&sensor->i2c_client->dev, 0);
+}
+
+/*
+ * Read count consecutive registers starting at regmap address reg. Cached
+ * registers come from the regmap cache, anything else is fetched with one
+ * auto-increment read in a single repeated-start transfer.
+ */
+static int gc0308_read_regs(struct gc0308 *sensor, unsigned int reg,
+			    u8 *vals, int count)
+{
+	int ret;
+
+	ret = regmap_bulk_read(sensor->regmap, reg, vals, count);
+	if (ret < 0) {
+		pr_err("%s:read reg error:reg=%x,count=%d\n",
+			__func__, reg, count);
+		return -1;
+	}
+
+	return 0;
 }
 
-static s32 gc0308_write_reg(u8 reg, u8 val)
+/* Read a page 0 register */
+static s32 gc0308_read_reg(struct gc0308 *sensor, u8 reg, u8 *val)
 {
-    u8 au8Buf[3] = {0};
+	if (gc0308_read_regs(sensor, GC0308_REG(0, reg), val, 1) < 0)
+		return -1;
 
-    au8Buf[0] = reg;
-    au8Buf[1] = val;
+	return *val;
+}
 
-    if (i2c_master_send(gc0308_data.i2c_client, au8Buf, 2) < 0) {
-        pr_err("%s:write reg error:reg=%x,val=%x\n",
-            __func__, reg, val);
-        return -1;
-    }
+/* Write count consecutive registers starting at regmap address reg */
+static int gc0308_write_regs(struct gc0308 *sensor, unsigned int reg,
+			     const u8 *vals, int count)
+{
+	int ret;
 
+	ret = regmap_bulk_write(sensor->regmap, reg, vals, count);
+	if (ret < 0) {
+		pr_err("%s:write reg error:reg=%x,count=%d\n",
+			__func__, reg, count);
+		return -1;
+	}
 
-    return 0;
+	return 0;
 }
 
-static s32 gc0308_read_reg(u8 reg, u8 *val)
+/*
+ * Write count consecutive cached registers, unless the cache shows they
+ * already hold vals. Returns 1 if anything was written, 0 if not.
+ */
+static int gc0308_update_regs(struct gc0308 *sensor, unsigned int reg,
+			      const u8 *vals, int count)
 {
-    u8 au8RegBuf[2] = {0};
-    u8 u8RdVal = 0;
+	u8 cur[GC0308_BURST_LEN];
 
-    au8RegBuf[0] = reg;
+	if (count <= sizeof(cur) &&
+	    gc0308_read_regs(sensor, reg, cur, count) == 0 &&
+	    !memcmp(cur, vals, count))
+		return 0;
 
+	if (gc0308_write_regs(sensor, reg, vals, count) < 0)
+		return -1;
 
-    if (1 != i2c_master_send(gc0308_data.i2c_client, au8RegBuf, 1)) {
-        pr_err("%s:write reg error:reg=%x\n",
-                __func__, reg);
-        return -1;
-    }
+	return 1;
+}
 
-    if (1 != i2c_master_recv(gc0308_data.i2c_client, &u8RdVal, 1)) {
-        pr_err("%s:read reg error:reg=%x,val=%x\n",
-                __func__, reg, u8RdVal);
-        return -1;
-    }
+/* True if reg is cached and already holds val */
+static bool gc0308_reg_unchanged(struct gc0308 *sensor, u8 page, u8 reg,
+				 u8 val)
+{
+	unsigned int vreg = GC0308_REG(page, reg);
+	unsigned int cur;
 
-    *val = u8RdVal;
+	/* burst_download=0 is the old path: every register is written */
+	if (!burst_download || gc0308_reg_volatile(vreg))
+		return false;
 
-    return u8RdVal;
+	return !regmap_read(sensor->regmap, vreg, &cur) && cur == val;
 }
 
-/* download gc0308 settings to sensor through i2c */
-static int gc0308_download_firmware(struct reg_value *pModeSetting, s32 ArySize)
-{	
-	register u8 RegAddr = 0;
-	register u8 Val = 0;
-	int i, retval = 0;
+static int gc0308_write_run(struct gc0308 *sensor, u8 page, u8 reg,
+			    const u8 *vals, int len)
+{
+	int i, ret = 0;
+
+	if (burst_download) {
+		ret = regmap_raw_write(sensor->regmap, GC0308_REG(page, reg),
+				       vals, len);
+	} else {
+		/* one write per register */
+		for (i = 0; i < len && ret >= 0; i++)
+			ret = regmap_write(sensor->regmap,
+					   GC0308_REG(page, reg + i), vals[i]);
+	}
 
-	for (i = 0; i < ArySize; ++i, ++pModeSetting) {
-		RegAddr = pModeSetting->u8RegAddr;
-		Val = pModeSetting->u8Val;
+	if (ret < 0) {
+		pr_err("%s:write error:page=%d,reg=%x,len=%d\n",
+			__func__, page, reg, len);
+		return -1;
+	}
 
-		retval = gc0308_write_reg(RegAddr, Val);
-		if (retval < 0)
-			goto err;
+	return 0;
+}
+
+/*
+ * download a register program to the sensor through i2c
+ *
+ * Each run goes out as one auto-increment burst. Registers the cache shows
+ * to already hold their value are skipped, splitting the run around them.
+ * With burst_download=0 nothing is skipped and each register gets its own
+ * write.
+ */
+static int gc0308_download_firmware(struct gc0308 *sensor, const u8 *prog)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	u8 hdr, page, reg, len;
+	int i, n, written = 0, skipped = 0, retval = 0;
+
+	lockdep_assert_held(&sensor->lock);
+
+	trace_gc0308_download_start(dev, prog);
+
+	while ((hdr = *prog++) != GC0308_PROG_END) {
+		page = GC0308_RUN_PAGE(hdr);
+		len = GC0308_RUN_LEN(hdr);
+		reg = *prog++;
+
+		for (i = 0; i < len; i += n) {
+			n = 1;
+			if (gc0308_reg_unchanged(sensor, page, reg + i,
+						 prog[i])) {
+				skipped++;
+				continue;
+			}
+
+			while (i + n < len &&
+			       !gc0308_reg_unchanged(sensor, page, reg + i + n,
+						     prog[i + n]))
+				n++;
+
+			retval = gc0308_write_run(sensor, page, reg + i,
+						  prog + i, n);
+			if (retval < 0)
+				goto out;
+			written += n;
+		}
+
+		prog += len;
 	}
-err:
+out:
+	trace_gc0308_download_end(dev, written, skipped, retval);
+
 	return retval;
 }
 
-static int gc0308_init_mode(void)
+/*
+ * Row time and frame length as currently programmed. The array is clocked
+ * at sys_clk and a row takes HB + sh_delay + window width + 4 clocks; a frame
+ * is VB + window height + 8 rows long.
+ */
+static int gc0308_get_frame_timing(struct gc0308 *sensor, u32 *row_ns,
+				   u32 *rows)
+{
+	u8 blank[2], win[4], hi, sh_delay;
+	u32 hb, vb, width, height;
+
+	if (gc0308_read_regs(sensor, GC0308_REG(0, GC0308_REG_HB),
+			     blank, 2) < 0 ||
+	    gc0308_read_regs(sensor, GC0308_REG(0, GC0308_REG_WIN_HEIGHT_H),
+			     win, 4) < 0 ||
+	    gc0308_read_regs(sensor, GC0308_REG(0, GC0308_REG_VB_HB_H),
+			     &hi, 1) < 0 ||
+	    gc0308_read_regs(sensor, GC0308_REG(0, GC0308_REG_SH_DELAY),
+			     &sh_delay, 1) < 0)
+		return -1;
+
+	hb = ((hi & 0x0f) << 8) | blank[0];
+	vb = ((hi & 0xf0) << 4) | blank[1];
+	height = ((win[0] & 0x01) << 8) | win[1];
+	width = ((win[2] & 0x03) << 8) | win[3];
+
+	*row_ns = div_u64((u64)(hb + sh_delay + width + 4) * NSEC_PER_SEC,
+			  sensor->sys_clk);
+	*rows = vb + height + 8;
+
+	return 0;
+}
+
+/*
+ * Program the blanking for the requested frame interval. Rows are kept as
+ * short as possible (GC0308_HB_MIN) and the rest of the frame period goes
+ * into vertical blanking; only when VB runs out of range are the rows
+ * stretched. The AEC anti-flicker step is a half period of the mains
+ * frequency in rows at the new row time. The four AEC exposure levels
+ * spread up to the frame length, or up to a frame at min_fps if that is
+ * set and slower, so AEC never stretches frames below the requested rate
+ * unless allowed to. timeperframe is updated to the interval the blanking
+ * actually gives, which the clock or the blanking limits may not let match.
+ */
+static int gc0308_set_frame_interval(struct gc0308 *sensor,
+				     struct v4l2_fract *timeperframe)
+{
+	u8 win[4], sh_delay, blank[2], hi, step[2];
+	u8 levels[GC0308_EXP_LEVELS * 2];
+	u32 width, height, hb, vb, row_clks, rows, row_ns, flicker, nsteps;
+	u32 exp_rows;
+	u64 frame_clks;
+	unsigned long div;
+	int i;
+
+	lockdep_assert_held(&sensor->lock);
+
+	if (gc0308_read_regs(sensor, GC0308_REG(0, GC0308_REG_WIN_HEIGHT_H),
+			     win, 4) < 0 ||
+	    gc0308_read_regs(sensor, GC0308_REG(0, GC0308_REG_SH_DELAY),
+			     &sh_delay, 1) < 0)
+		return -1;
+
+	height = ((win[0] & 0x01) << 8) | win[1];
+	width = ((win[2] & 0x03) << 8) | win[3];
+
+	/* array clocks per frame */
+	frame_clks = div_u64((u64)sensor->sys_clk * timeperframe->numerator,
+			     timeperframe->denominator);
+
+	hb = GC0308_HB_MIN;
+	row_clks = hb + sh_delay + width + 4;
+	if (div_u64(frame_clks, row_clks) > height + 8 + GC0308_VB_MAX) {
+		row_clks = div_u64(frame_clks + height + 8 + GC0308_VB_MAX - 1,
+				   height + 8 + GC0308_VB_MAX);
+		hb = min_t(u32, row_clks - sh_delay - width - 4, GC0308_HB_MAX);
+		row_clks = hb + sh_delay + width + 4;
+	}
+	rows = div_u64(frame_clks, row_clks);
+	vb = clamp_t(u32, rows, height + 8, height + 8 + GC0308_VB_MAX) -
+	     height - 8;
+	rows = vb + height + 8;
+
+	blank[0] = hb & 0xff;
+	blank[1] = vb & 0xff;
+	hi = ((vb >> 4) & 0xf0) | ((hb >> 8) & 0x0f);
+	if (gc0308_update_regs(sensor, GC0308_REG(0, GC0308_REG_HB),
+			       blank, 2) < 0 ||
+	    gc0308_update_regs(sensor, GC0308_REG(0, GC0308_REG_VB_HB_H),
+			       &hi, 1) < 0)
+		return -1;
+
+	/* rows per half period of the mains, exposure is free without one */
+	row_ns = div_u64((u64)row_clks * NSEC_PER_SEC, sensor->sys_clk);
+	switch (sensor->power_line) {
+	case V4L2_CID_POWER_LINE_FREQUENCY_50HZ:
+		flicker = DIV_ROUND_CLOSEST(NSEC_PER_SEC / 100, row_ns);
+		break;
+	case V4L2_CID_POWER_LINE_FREQUENCY_60HZ:
+		flicker = DIV_ROUND_CLOSEST(NSEC_PER_SEC / 120, row_ns);
+		break;
+	default:
+		flicker = 1;
+		break;
+	}
+	flicker = max_t(u32, flicker, 1);
+	step[0] = (flicker >> 8) & 0x0f;
+	step[1] = flicker & 0xff;
+
+	exp_rows = rows;
+	if (sensor->min_fps)
+		exp_rows = max_t(u32, rows,
+				 div_u64(sensor->sys_clk,
+					 sensor->min_fps * row_clks));
+	exp_rows = min_t(u32, exp_rows, GC0308_EXPOSURE_MAX);
+
+	nsteps = max_t(u32, exp_rows / flicker, 1);
+	for (i = 0; i < GC0308_EXP_LEVELS; i++) {
+		u32 exp = flicker * max_t(u32, nsteps * (i + 1) /
+					  GC0308_EXP_LEVELS, 1);
+
+		levels[2 * i] = (exp >> 8) & 0x0f;
+		levels[2 * i + 1] = exp & 0xff;
+	}
+
+	/* let AEC use all four levels, the table stops it at the third */
+	if (gc0308_update_regs(sensor,
+			       GC0308_REG(0, GC0308_REG_FLICKER_STEP_H),
+			       step, 2) < 0 ||
+	    gc0308_update_regs(sensor, GC0308_REG(0, GC0308_REG_EXP_LEVEL1_H),
+			       levels, sizeof(levels)) < 0 ||
+	    regmap_update_bits(sensor->regmap,
+			       GC0308_REG(0, GC0308_REG_EXP_LEVEL_SEL),
+			       GC0308_EXP_LEVEL_SEL_MASK,
+			       GC0308_EXP_LEVEL_SEL_MASK) < 0)
+		return -1;
+
+	div = gcd(rows * row_clks, sensor->sys_clk);
+	timeperframe->numerator = rows * row_clks / div;
+	timeperframe->denominator = sensor->sys_clk / div;
+
+	pr_debug("%s: %u/%u s: hb %u vb %u, %u rows of %u ns, step %u, "
+		 "max exposure %u\n", __func__, timeperframe->numerator,
+		 timeperframe->denominator, hb, vb, rows, row_ns, flicker,
+		 exp_rows);
+
+	return 0;
+}
+
+/*
+ * Program the requested frame interval for the current window and publish
+ * the one achieved.
+ */
+static int gc0308_apply_frame_interval(struct gc0308 *sensor)
+{
+	struct v4l2_fract timeperframe = sensor->frame_interval;
+
+	if (gc0308_set_frame_interval(sensor, &timeperframe) < 0)
+		return -1;
+
+	spin_lock(&sensor->state_lock);
+	sensor->streamcap.timeperframe = timeperframe;
+	spin_unlock(&sensor->state_lock);
+
+	return 0;
+}
+
+/*
+ * Wait until the sensor delivers usable frames after being programmed: at
+ * least GC0308_SETTLE_MIN_FRAMES frames, then until AEC leaves the exposure
+ * alone for a frame, but no more than GC0308_SETTLE_MAX_FRAMES frames. The
+ * frame period follows the programmed timing, so slow frame rates wait
+ * longer and fast ones don't pay for a fixed worst case; GC0308_SETTLE_MAX_US
+ * bounds the wait at slow rates, where ten frames would take seconds.
+ */
+static int gc0308_wait_settle(struct gc0308 *sensor)
+{
+	ktime_t start = ktime_get();
+	u32 row_ns, rows, exp = 0, prev_exp = 0, frame_us, elapsed_us;
+	u8 buf[2];
+	int frame;
+
+	if (gc0308_get_frame_timing(sensor, &row_ns, &rows) < 0)
+		return -1;
+
+	for (frame = 1; frame <= GC0308_SETTLE_MAX_FRAMES; frame++) {
+		/* a long AEC exposure stretches the frame */
+		frame_us = div_u64((u64)max(rows, exp) * row_ns, NSEC_PER_USEC);
+		elapsed_us = ktime_us_delta(ktime_get(), start);
+		if (elapsed_us >= GC0308_SETTLE_MAX_US)
+			break;
+		frame_us = min(frame_us, GC0308_SETTLE_MAX_US - elapsed_us);
+		if (frame_us < 20000)
+			usleep_range(frame_us, frame_us + 1000);
+		else
+			msleep(DIV_ROUND_UP(frame_us, 1000));
+
+		if (gc0308_read_regs(sensor,
+				     GC0308_REG(0, GC0308_REG_EXPOSURE_H),
+				     buf, 2) < 0)
+			return -1;
+		exp = ((buf[0] & 0x0f) << 8) | buf[1];
+
+		if (frame >= GC0308_SETTLE_MIN_FRAMES && exp == prev_exp)
+			break;
+		prev_exp = exp;
+	}
+
+	sensor->settle_us = ktime_us_delta(ktime_get(), start);
+	pr_debug("%s: settled after %d frames, %u us\n", __func__,
+		 min(frame, GC0308_SETTLE_MAX_FRAMES), sensor->settle_us);
+
+	return 0;
+}
+
+/*
+ * Program the image controls from the cached settings. Only registers that
+ * differ from the cache are written, so an unchanged control costs no I/O.
+ */
+static int gc0308_write_image_ctrls(struct gc0308 *sensor)
+{
+	struct regmap *map = sensor->regmap;
+	int ret;
+
+	ret = regmap_update_bits(map, GC0308_REG(0, GC0308_REG_LUMA_OFFSET),
+				 0xff, (u8)sensor->brightness);
+	if (ret < 0)
+		return ret;
+
+	ret = regmap_update_bits(map, GC0308_REG(0, GC0308_REG_CONTRAST),
+				 0xff, sensor->contrast);
+	if (ret < 0)
+		return ret;
+
+	/* Cb and Cr saturation move together */
+	ret = regmap_update_bits(map, GC0308_REG(0, GC0308_REG_SATURATION_CB),
+				 0xff, sensor->saturation);
+	if (ret < 0)
+		return ret;
+
+	return regmap_update_bits(map,
+				  GC0308_REG(0, GC0308_REG_SATURATION_CB + 1),
+				  0xff, sensor->saturation);
+}
+
+/*
+ * The AWB gains are volatile: they're only written in manual mode, and are
+ * lost while the sensor is suspended, so resume calls this again.
+ */
+static int gc0308_write_awb(struct gc0308 *sensor)
+{
+	u8 gains[3];
+	int ret;
+
+	bool awb = sensor->auto_wb && !sensor->test_pattern;
+
+	ret = regmap_update_bits(sensor->regmap,
+				 GC0308_REG(0, GC0308_REG_AAAA_EN),
+				 GC0308_AWB_EN, awb ? GC0308_AWB_EN : 0);
+	if (ret < 0 || awb)
+		return ret;
+
+	gains[0] = sensor->red;
+	gains[1] = sensor->green;
+	gains[2] = sensor->blue;
+
+	return gc0308_write_regs(sensor, GC0308_REG(0, GC0308_REG_AWB_R_GAIN),
+				 gains, 3);
+}
+
+static bool gc0308_aec_enabled(struct gc0308 *sensor)
+{
+	if (sensor->test_pattern)
+		return false;
+
+	return sensor->ae_mode == V4L2_EXPOSURE_AUTO ||
+	       sensor->autogain;
+}
+
+static int gc0308_write_gain(struct gc0308 *sensor)
+{
+	/* a plain write, volatile registers can't be read while suspended */
+	return regmap_write(sensor->regmap,
+			    GC0308_REG(0, GC0308_REG_GLOBAL_GAIN),
+			    sensor->gain & GC0308_GAIN_MAX);
+}
+
+static void gc0308_gain_work(struct work_struct *work)
 {
-	struct reg_value *pModeSetting = NULL;
-	int ArySize = 0, retval = 0;
+	struct gc0308 *sensor = container_of(to_delayed_work(work),
+					     struct gc0308, gain_work);
 
-	pModeSetting = gc0308_default_setting;
-	ArySize = ARRAY_SIZE(gc0308_default_setting);
-	retval = gc0308_download_firmware(pModeSetting, ArySize);
+	mutex_lock(&sensor->lock);
+	if (!gc0308_aec_enabled(sensor) && gc0308_write_gain(sensor) < 0)
+		pr_err("%s:gain write failed\n", __func__);
+	mutex_unlock(&sensor->lock);
+}
+
+/*
+ * AEC runs when either auto control is set. Otherwise the manual exposure
+ * goes out as one burst so the sensor never latches half of it, and with
+ * @stage, while streaming, the gain write is left to gain_work one frame
+ * period later (see GC0308_CTRL_LATENCY). The driver sees no frame start,
+ * so that is a frame after the exposure write rather than at a boundary; it
+ * still falls in the next frame, which is all the staging needs. Nothing
+ * sleeps here, so the control handler isn't held up for the frame.
+ *
+ * The exposure and gain registers are volatile and, like the AWB gains, are
+ * rewritten on resume.
+ */
+static int gc0308_write_aec(struct gc0308 *sensor, bool stage)
+{
+	u32 row_ns, rows, frame_us;
+	u8 exp[2];
+	int ret;
+
+	/* a staged write still pending is superseded by this one */
+	cancel_delayed_work(&sensor->gain_work);
+
+	ret = regmap_update_bits(sensor->regmap,
+				 GC0308_REG(0, GC0308_REG_AEC_MODE),
+				 GC0308_AEC_EN,
+				 gc0308_aec_enabled(sensor) ?
+				 GC0308_AEC_EN : 0);
+	if (ret < 0 || gc0308_aec_enabled(sensor))
+		return ret;
+
+	exp[0] = (sensor->exposure >> 8) & 0x0f;
+	exp[1] = sensor->exposure & 0xff;
+	ret = gc0308_write_regs(sensor, GC0308_REG(0, GC0308_REG_EXPOSURE_H),
+				exp, 2);
+	if (ret < 0)
+		return ret;
+
+	/* streaming keeps the sensor resumed, so the timing reads are live */
+	if (stage && sensor->streaming &&
+	    gc0308_get_frame_timing(sensor, &row_ns, &rows) == 0) {
+		frame_us = div_u64((u64)max_t(u32, rows, sensor->exposure) *
+				   row_ns, NSEC_PER_USEC);
+		schedule_delayed_work(&sensor->gain_work,
+				      usecs_to_jiffies(frame_us));
+		return 0;
+	}
+
+	return gc0308_write_gain(sensor);
+}
+
+static const char * const gc0308_test_pattern_menu[] = {
+	"Disabled",
+	"Colour Bars",
+	"Gradient",
+};
+
+/*
+ * The test image goes through the ISP, so AEC and AWB are held (at the
+ * manual exposure, gain and white balance settings) while it is shown:
+ * every frame of a run is then identical, and so is every run.
+ */
+static int gc0308_write_test_pattern(struct gc0308 *sensor)
+{
+	u8 val = 0;
+	int ret;
+
+	if (sensor->test_pattern)
+		val = GC0308_TEST_IMAGE_EN;
+	if (sensor->test_pattern == 2)
+		val |= GC0308_TEST_IMAGE_GRADIENT;
+
+	ret = regmap_update_bits(sensor->regmap,
+				 GC0308_REG(0, GC0308_REG_DEBUG_MODE2),
+				 GC0308_TEST_IMAGE_EN |
+				 GC0308_TEST_IMAGE_GRADIENT, val);
+	if (ret < 0)
+		return ret;
+
+	ret = gc0308_write_awb(sensor);
+	if (ret < 0)
+		return ret;
+
+	return gc0308_write_aec(sensor, false);
+}
+
+/* Vendor RGB gamma curves, 1 is the darkest and 3 the table default */
+static const u8 gc0308_gamma_curves[][GC0308_GAMMA_POINTS] = {
+	{
+		0x0b, 0x16, 0x29, 0x3c, 0x4f, 0x5f, 0x6f, 0x8a,
+		0x9f, 0xb4, 0xc6, 0xd3, 0xdd, 0xe5, 0xf1, 0xfa,
+		0xff,
+	}, {
+		0x0e, 0x1c, 0x34, 0x48, 0x5a, 0x6b, 0x7b, 0x95,
+		0xab, 0xbf, 0xce, 0xd9, 0xe4, 0xec, 0xf7, 0xfd,
+		0xff,
+	}, {
+		0x10, 0x20, 0x38, 0x4e, 0x63, 0x76, 0x87, 0xa2,
+		0xb8, 0xca, 0xd8, 0xe3, 0xeb, 0xf0, 0xf8, 0xfd,
+		0xff,
+	}, {
+		0x14, 0x28, 0x44, 0x5d, 0x72, 0x86, 0x95, 0xb1,
+		0xc6, 0xd5, 0xe1, 0xea, 0xf1, 0xf5, 0xfb, 0xfe,
+		0xff,
+	}, {
+		0x15, 0x2a, 0x4a, 0x67, 0x79, 0x8c, 0x9a, 0xb3,
+		0xc5, 0xd5, 0xdf, 0xe8, 0xee, 0xf3, 0xfa, 0xfd,
+		0xff,
+	},
+};
+
+#define GC0308_GAMMA_DEF	3
+
+struct gc0308_colorfx {
+	u8 effect;
+	u8 cb;
+	u8 cr;
+};
+
+/* Effects the special effect block can do, the rest are masked out */
+static const struct gc0308_colorfx gc0308_colorfx[] = {
+	[V4L2_COLORFX_NONE]		= { 0, 0x00, 0x00 },
+	[V4L2_COLORFX_BW]		= { GC0308_FX_FIXED_CBCR, 0x00, 0x00 },
+	[V4L2_COLORFX_SEPIA]		= { GC0308_FX_FIXED_CBCR, 0xd0, 0x28 },
+	[V4L2_COLORFX_NEGATIVE]		= { GC0308_FX_NEGATIVE, 0x00, 0x00 },
+	[V4L2_COLORFX_SKY_BLUE]		= { GC0308_FX_FIXED_CBCR, 0x50, 0xe0 },
+	[V4L2_COLORFX_GRASS_GREEN]	= { GC0308_FX_FIXED_CBCR, 0xc0, 0xc0 },
+};
+
+#define GC0308_COLORFX_SKIP \
+	(BIT(V4L2_COLORFX_EMBOSS) | BIT(V4L2_COLORFX_SKETCH))
+
+/*
+ * Program the ISP stage controls. Sharpness scales both edge enhancement
+ * gains from the table's 0x38 at the default level of 4. Like the image
+ * controls, registers that already hold their value cost no I/O, and a new
+ * gamma curve goes out as a single burst.
+ */
+static int gc0308_write_isp_ctrls(struct gc0308 *sensor)
+{
+	const struct gc0308_colorfx *fx = &gc0308_colorfx[sensor->colorfx];
+	struct regmap *map = sensor->regmap;
+	u8 edge1 = 3 * sensor->sharpness / 4;
+	u8 edge2 = min(2 * sensor->sharpness, 0x0f);
+	u8 cbcr[2] = { fx->cb, fx->cr };
+	int ret;
+
+	ret = regmap_update_bits(map, GC0308_REG(0, GC0308_REG_EDGE12_EFFECT),
+				 0xff, (edge1 << 4) | edge2);
+	if (ret < 0)
+		return ret;
+
+	ret = regmap_update_bits(map, GC0308_REG(0, GC0308_REG_DN_BILAT_B_BASE),
+				 0xff, sensor->denoise);
+	if (ret < 0)
+		return ret;
+
+	ret = gc0308_update_regs(sensor, GC0308_REG(0, GC0308_REG_GAMMA),
+				 gc0308_gamma_curves[sensor->gamma - 1],
+				 GC0308_GAMMA_POINTS);
+	if (ret < 0)
+		return ret;
+
+	ret = gc0308_update_regs(sensor, GC0308_REG(0, GC0308_REG_FIXED_CB),
+				 cbcr, 2);
+	if (ret < 0)
+		return ret;
+
+	return regmap_update_bits(map, GC0308_REG(0, GC0308_REG_SPECIAL_EFFECT),
+				  GC0308_FX_NEGATIVE | GC0308_FX_FIXED_CBCR,
+				  fx->effect);
+}
+
+/*
+ * The default table already mirrors the readout to suit the module optics,
+ * so the flip controls toggle the readout direction relative to it. The
+ * ISP follows the readout, no other register needs fixing up.
+ */
+static int gc0308_write_flip(struct gc0308 *sensor)
+{
+	u8 val = GC0308_CISCTL_MODE1_DEF;
+
+	if (sensor->hflip)
+		val ^= GC0308_HFLIP;
+	if (sensor->vflip)
+		val ^= GC0308_VFLIP;
+
+	return regmap_update_bits(sensor->regmap,
+				  GC0308_REG(0, GC0308_REG_CISCTL_MODE1),
+				  GC0308_HFLIP | GC0308_VFLIP, val);
+}
+
+static int gc0308_write_clk_div(struct gc0308 *sensor)
+{
+	return regmap_update_bits(sensor->regmap,
+				  GC0308_REG(0, GC0308_REG_CLK_DIV), 0x0f,
+				  sensor->clk_div - 1);
+}
+
+static int gc0308_write_output_fmt(struct gc0308 *sensor,
+				   const struct gc0308_datafmt *fmt)
+{
+	return regmap_update_bits(sensor->regmap,
+				  GC0308_REG(0, GC0308_REG_OUTPUT_FMT),
+				  0xff, fmt->output_fmt);
+}
+
+static int gc0308_init_mode(struct gc0308 *sensor, enum gc0308_mode mode)
+{
+	struct gc0308_mode_info *info;
+	int retval = 0;
+
+	if (mode > gc0308_mode_MAX || mode < gc0308_mode_MIN) {
+		pr_err("Wrong gc0308 mode detected!\n");
+		return -1;
+	}
+
+	/* the register setup is the same for every frame rate */
+	info = &gc0308_mode_info_data[gc0308_30_fps][mode];
+
+	retval = gc0308_download_firmware(sensor, info->init_data_ptr);
+	if (retval < 0)
+		goto err;
+
+	retval = gc0308_download_firmware(sensor, info->mode_data_ptr);
+	if (retval < 0)
+		goto err;
+
+	retval = gc0308_write_clk_div(sensor);
+	if (retval < 0)
+		goto err;
+
+	/* the tables carry the control defaults, restore the user's settings */
+	retval = gc0308_write_output_fmt(sensor, sensor->fmt);
+	if (retval < 0)
+		goto err;
+
+	retval = gc0308_write_image_ctrls(sensor);
+	if (retval < 0)
+		goto err;
+
+	retval = gc0308_write_flip(sensor);
+	if (retval < 0)
+		goto err;
+
+	retval = gc0308_write_isp_ctrls(sensor);
+	if (retval < 0)
+		goto err;
+
+	/* also restores AWB and AEC, which the test image holds */
+	retval = gc0308_write_test_pattern(sensor);
+	if (retval < 0)
+		goto err;
+
+	retval = gc0308_apply_frame_interval(sensor);
 	if (retval < 0)
 		goto err;
 
-	/* skip 9 vysnc: start capture at 10th vsync */
-	msleep(300);
+	retval = gc0308_wait_settle(sensor);
+	if (retval < 0)
+		goto err;
 
-	gc0308_data.pix.width = 640;
-	gc0308_data.pix.height = 480;
+	spin_lock(&sensor->state_lock);
+	sensor->mode = mode;
+	sensor->crop.left = 0;
+	sensor->crop.top = 0;
+	sensor->crop.width = GC0308_ARRAY_WIDTH;
+	sensor->crop.height = GC0308_ARRAY_HEIGHT;
+	sensor->pix.width = info->width;
+	sensor->pix.height = info->height;
+	spin_unlock(&sensor->state_lock);
 err:
 	return retval;
 }
 
+/* Program the array window; returns 1 if it changed, 0 if not */
+static int gc0308_write_window(struct gc0308 *sensor,
+			       const struct v4l2_rect *rect)
+{
+	u32 height = rect->height + GC0308_WIN_PAD_H;
+	u32 width = rect->width + GC0308_WIN_PAD_W;
+	u8 win[8];
+
+	win[0] = (rect->top >> 8) & 0x01;
+	win[1] = rect->top & 0xff;
+	win[2] = (rect->left >> 8) & 0x03;
+	win[3] = rect->left & 0xff;
+	win[4] = (height >> 8) & 0x01;
+	win[5] = height & 0xff;
+	win[6] = (width >> 8) & 0x03;
+	win[7] = width & 0xff;
+
+	return gc0308_update_regs(sensor, GC0308_REG(0, GC0308_REG_ROW_START_H),
+				  win, sizeof(win));
+}
+
+/*
+ * Restrict the array readout to @rect. The output is taken 1:1 from the
+ * window, so only the region of interest goes over the bus, and the frame
+ * interval is reprogrammed because the row and frame lengths change with it.
+ */
+static int gc0308_set_window(struct gc0308 *sensor,
+			     const struct v4l2_rect *rect)
+{
+	struct gc0308_mode_info *info =
+		&gc0308_mode_info_data[gc0308_30_fps][gc0308_mode_VGA_640_480];
+	int retval;
+
+	retval = gc0308_write_window(sensor, rect);
+	if (retval < 0)
+		return retval;
+
+	/* no subsampling or output crop on top of the window */
+	retval = gc0308_download_firmware(sensor, info->mode_data_ptr);
+	if (retval < 0)
+		return retval;
+
+	retval = gc0308_apply_frame_interval(sensor);
+	if (retval < 0)
+		return retval;
+
+	spin_lock(&sensor->state_lock);
+	sensor->mode = gc0308_mode_VGA_640_480;
+	sensor->crop = *rect;
+	sensor->pix.width = rect->width;
+	sensor->pix.height = rect->height;
+	spin_unlock(&sensor->state_lock);
+
+	return 0;
+}
+
+/*
+ * Switch an initialised sensor to another mode. All modes share the base
+ * program, so only the mode's size setup is downloaded, and the register
+ * cache trims it to the registers that actually differ from the current
+ * state (cropped or not). The frame timing depends only on the array
+ * window: unless a crop is being undone, blanking, flicker step and
+ * exposure levels stay valid and there is nothing to settle.
+ */
+static int gc0308_switch_mode(struct gc0308 *sensor, enum gc0308_mode mode)
+{
+	struct gc0308_mode_info *info =
+		&gc0308_mode_info_data[gc0308_30_fps][mode];
+	struct v4l2_rect full = {
+		.width = GC0308_ARRAY_WIDTH,
+		.height = GC0308_ARRAY_HEIGHT,
+	};
+	int retval, timing_changed;
+
+	timing_changed = gc0308_write_window(sensor, &full);
+	if (timing_changed < 0)
+		return timing_changed;
+
+	retval = gc0308_download_firmware(sensor, info->mode_data_ptr);
+	if (retval < 0)
+		return retval;
+
+	if (timing_changed) {
+		retval = gc0308_apply_frame_interval(sensor);
+		if (retval < 0)
+			return retval;
+
+		retval = gc0308_wait_settle(sensor);
+		if (retval < 0)
+			return retval;
+	}
+
+	spin_lock(&sensor->state_lock);
+	sensor->mode = mode;
+	sensor->crop = full;
+	sensor->pix.width = info->width;
+	sensor->pix.height = info->height;
+	spin_unlock(&sensor->state_lock);
+
+	return 0;
+}
+
+/* The supported size closest to, and if possible no smaller than, w x h */
+static enum gc0308_mode gc0308_find_mode(u32 width, u32 height)
+{
+	enum gc0308_mode mode, best = gc0308_mode_VGA_640_480;
+	struct gc0308_mode_info *info, *b;
+
+	for (mode = gc0308_mode_MIN; mode <= gc0308_mode_MAX; mode++) {
+		info = &gc0308_mode_info_data[gc0308_30_fps][mode];
+		b = &gc0308_mode_info_data[gc0308_30_fps][best];
+
+		if (info->width == width && info->height == height)
+			return mode;
+		if (info->width >= width && info->height >= height &&
+		    info->width * info->height < b->width * b->height)
+			best = mode;
+	}
+
+	return best;
+}
+
+/*
+ * Ops that need a programmed sensor wait here for the init to finish, and
+ * fail if it did. The subdev is registered before the init is started, so
+ * this can't just flush the worker: it may not be queued yet.
+ */
+static int gc0308_wait_init(struct gc0308 *sensor)
+{
+	wait_for_completion(&sensor->init_done);
+
+	return sensor->init_err;
+}
+
+/* Write back what was cached while suspended, see gc0308_runtime_resume() */
+static int gc0308_restore_regs(struct gc0308 *sensor)
+{
+	int ret;
+
+	regcache_cache_only(sensor->regmap, false);
+	ret = regcache_sync(sensor->regmap);
+	gc0308_drop_page_cache(sensor);
+	if (ret == 0)
+		ret = gc0308_write_awb(sensor);
+	if (ret == 0)
+		ret = gc0308_write_aec(sensor, false);
+	if (ret < 0) {
+		dev_err(&sensor->i2c_client->dev,
+			"restoring registers failed: %d\n", ret);
+		regcache_cache_only(sensor->regmap, true);
+		return ret;
+	}
+
+	sensor->restore_pending = false;
+
+	return 0;
+}
+
+/*
+ * Resume the sensor for a register sequence, with sensor->lock held, and
+ * finish a resume that left the registers to be restored. Dropped with
+ * pm_runtime_put_autosuspend() as usual.
+ */
+static int gc0308_pm_get(struct gc0308 *sensor)
+{
+	struct device *dev = &sensor->i2c_client->dev;
+	int ret;
+
+	lockdep_assert_held(&sensor->lock);
+
+	ret = pm_runtime_get_sync(dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	if (sensor->restore_pending) {
+		ret = gc0308_restore_regs(sensor);
+		if (ret < 0) {
+			pm_runtime_put_autosuspend(dev);
+			return ret;
+		}
+	}
+
+	return 0;
+}
 
 /*!
  * gc0308_s_power - V4L2 sensor interface handler for VIDIOC_S_POWER ioctl
@@ -849,21 +1615,44 @@ err:
  * @on: indicates power mode (on or off)
  *
  * Turns the power on or off, depending on the value of on and returns the
- * appropriate error code.
+ * appropriate error code. The sensor is actually powered down through
+ * runtime PM once it has been idle for autosuspend_delay_ms.
  */
 static int gc0308_s_power(struct v4l2_subdev *sd, int on)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct gc0308 *sensor = to_gc0308(client);
+	int ret;
 
-	if (on)
-		clk_enable(gc0308_data.sensor_clk);
-	else
-		clk_disable(gc0308_data.sensor_clk);
+	ret = gc0308_wait_init(sensor);
+	if (ret < 0)
+		return ret;
+
+	trace_gc0308_s_power(&client->dev, on);
+
+	/* resume restores registers, keep it apart from other sequences */
+	mutex_lock(&sensor->lock);
+	/* only a change takes or drops the reference, keeping calls balanced */
+	if (!on == !sensor->on) {
+		ret = 0;
+		goto out;
+	}
+
+	if (on) {
+		ret = gc0308_pm_get(sensor);
+		if (ret < 0)
+			goto out;
+	} else {
+		pm_runtime_mark_last_busy(&client->dev);
+		pm_runtime_put_autosuspend(&client->dev);
+	}
 
 	sensor->on = on;
+	ret = 0;
+out:
+	mutex_unlock(&sensor->lock);
 
-	return 0;
+	return ret;
 }
 
 /*!
@@ -885,9 +1674,11 @@ static int gc0308_g_parm(struct v4l2_subdev *sd, struct v4l2_streamparm *a)
 	case V4L2_BUF_TYPE_VIDEO_CAPTURE:
 		memset(a, 0, sizeof(*a));
 		a->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		spin_lock(&sensor->state_lock);
 		cparm->capability = sensor->streamcap.capability;
 		cparm->timeperframe = sensor->streamcap.timeperframe;
 		cparm->capturemode = sensor->streamcap.capturemode;
+		spin_unlock(&sensor->state_lock);
 		ret = 0;
 		break;
 
@@ -924,9 +1715,13 @@ static int gc0308_s_parm(struct v4l2_subdev *sd, struct v4l2_streamparm *a)
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct gc0308 *sensor = to_gc0308(client);
 	struct v4l2_fract *timeperframe = &a->parm.capture.timeperframe;
+	struct v4l2_fract req = *timeperframe, prev;
 	u32 tgt_fps;	/* target frames per secound */
-	enum gc0308_frame_rate frame_rate;
-	int ret = 0;
+	int ret;
+
+	ret = gc0308_wait_init(sensor);
+	if (ret < 0)
+		return ret;
 
 	switch (a->type) {
 	/* This is the only case currently handled. */
@@ -949,22 +1744,32 @@ static int gc0308_s_parm(struct v4l2_subdev *sd, struct v4l2_streamparm *a)
 			timeperframe->numerator = 1;
 		}
 
-		/* Actual frame rate we use */
-		tgt_fps = timeperframe->denominator /
-			  timeperframe->numerator;
-
-		if (tgt_fps == 15)
-			frame_rate = gc0308_15_fps;
-		else if (tgt_fps == 30)
-			frame_rate = gc0308_30_fps;
-		else {
+		/*
+		 * Any rate in between is programmed through the blanking, and
+		 * the caller gets back the interval that was achieved.
+		 */
+		mutex_lock(&sensor->lock);
+		prev = sensor->frame_interval;
+		sensor->frame_interval = *timeperframe;
+		ret = gc0308_apply_frame_interval(sensor);
+		if (ret < 0) {
+			sensor->frame_interval = prev;
+		} else {
+			*timeperframe = sensor->streamcap.timeperframe;
+			spin_lock(&sensor->state_lock);
+			sensor->streamcap.capturemode =
+				a->parm.capture.capturemode;
+			spin_unlock(&sensor->state_lock);
+		}
+		trace_gc0308_s_parm(&client->dev, req.numerator,
+				    req.denominator, timeperframe->numerator,
+				    timeperframe->denominator, ret);
+		mutex_unlock(&sensor->lock);
+		if (ret < 0) {
 			pr_err(" The camera frame rate is not supported!\n");
 			goto error;
 		}
 
-		sensor->streamcap.timeperframe = *timeperframe;
-		sensor->streamcap.capturemode = a->parm.capture.capturemode;
-
 		break;
 
 	/* These are all the possible cases. */
@@ -980,13 +1785,158 @@ static int gc0308_s_parm(struct v4l2_subdev *sd, struct v4l2_streamparm *a)
 		ret = -EINVAL;
 		break;
 
-	default:
-		pr_debug("   type is unknown - %d\n", a->type);
-		ret = -EINVAL;
-		break;
+	default:
+		pr_debug("   type is unknown - %d\n", a->type);
+		ret = -EINVAL;
+		break;
+	}
+
+error:
+	return ret;
+}
+
+/*!
+ * gc0308_s_stream - V4L2 sensor interface handler for s_stream
+ * @sd: pointer to standard V4L2 sub device structure
+ * @enable: start (1) or stop (0) the sensor output
+ *
+ * Stopping tri-states the data, sync and pixel clock pads. The sensor
+ * stays configured, so starting again is a single register write and the
+ * next frame goes out on the bus. While streaming the sensor is kept
+ * powered.
+ */
+static int gc0308_s_stream(struct v4l2_subdev *sd, int enable)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct gc0308 *sensor = to_gc0308(client);
+	int ret;
+
+	ret = gc0308_wait_init(sensor);
+	if (ret < 0)
+		return ret;
+
+	enable = !!enable;
+
+	mutex_lock(&sensor->lock);
+	if (enable == sensor->streaming) {
+		/*
+		 * The tables leave the outputs on, so a stop before any start
+		 * must still turn them off. Lands in the cache if suspended.
+		 */
+		if (!enable)
+			ret = regmap_update_bits(sensor->regmap,
+					GC0308_REG(0, GC0308_REG_OUTPUT_EN),
+					0xff, 0);
+		goto out;
+	}
+
+	if (enable) {
+		ret = gc0308_pm_get(sensor);
+		if (ret < 0)
+			goto out;
+	}
+
+	ret = regmap_write(sensor->regmap,
+			   GC0308_REG(0, GC0308_REG_OUTPUT_EN),
+			   enable ? GC0308_OUTPUT_EN_ALL : 0);
+	if (ret < 0) {
+		pr_err("%s:output enable error:%d\n", __func__, ret);
+		if (enable)
+			pm_runtime_put_autosuspend(&client->dev);
+		goto out;
+	}
+
+	if (!enable) {
+		pm_runtime_mark_last_busy(&client->dev);
+		pm_runtime_put_autosuspend(&client->dev);
+	}
+
+	sensor->streaming = enable;
+out:
+	mutex_unlock(&sensor->lock);
+	return ret;
+}
+
+static int gc0308_cropcap(struct v4l2_subdev *sd, struct v4l2_cropcap *a)
+{
+	if (a->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		return -EINVAL;
+
+	a->bounds.left = 0;
+	a->bounds.top = 0;
+	a->bounds.width = GC0308_ARRAY_WIDTH;
+	a->bounds.height = GC0308_ARRAY_HEIGHT;
+	a->defrect = a->bounds;
+	a->pixelaspect.numerator = 1;
+	a->pixelaspect.denominator = 1;
+
+	return 0;
+}
+
+static int gc0308_g_crop(struct v4l2_subdev *sd, struct v4l2_crop *a)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct gc0308 *sensor = to_gc0308(client);
+
+	if (a->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		return -EINVAL;
+
+	spin_lock(&sensor->state_lock);
+	a->c = sensor->crop;
+	spin_unlock(&sensor->state_lock);
+
+	return 0;
+}
+
+/*!
+ * gc0308_s_crop - V4L2 sensor interface handler for VIDIOC_S_CROP ioctl
+ * @sd: pointer to standard V4L2 sub device structure
+ * @a: requested window in array pixels
+ *
+ * Programs the sensor window to the requested region, kept on even pixels
+ * so the YUYV pairs stay intact. The output size follows the window.
+ */
+static int gc0308_s_crop(struct v4l2_subdev *sd, const struct v4l2_crop *a)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct gc0308 *sensor = to_gc0308(client);
+	struct v4l2_rect rect = a->c;
+	int ret;
+
+	if (a->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		return -EINVAL;
+
+	rect.width = clamp_t(u32, rect.width & ~1, GC0308_CROP_MIN,
+			     GC0308_ARRAY_WIDTH);
+	rect.height = clamp_t(u32, rect.height & ~1, GC0308_CROP_MIN,
+			      GC0308_ARRAY_HEIGHT);
+	rect.left = clamp_t(s32, rect.left & ~1, 0,
+			    GC0308_ARRAY_WIDTH - rect.width);
+	rect.top = clamp_t(s32, rect.top & ~1, 0,
+			   GC0308_ARRAY_HEIGHT - rect.height);
+
+	ret = gc0308_wait_init(sensor);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&sensor->lock);
+	/* the frame size must not change under a running stream */
+	if (sensor->streaming) {
+		ret = -EBUSY;
+		goto out;
 	}
 
-error:
+	ret = gc0308_pm_get(sensor);
+	if (ret < 0)
+		goto out;
+
+	ret = gc0308_set_window(sensor, &rect);
+
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_put_autosuspend(&client->dev);
+out:
+	mutex_unlock(&sensor->lock);
+
 	return ret;
 }
 
@@ -994,12 +1944,18 @@ static int gc0308_try_fmt(struct v4l2_subdev *sd,
 			  struct v4l2_mbus_framefmt *mf)
 {
 	const struct gc0308_datafmt *fmt = gc0308_find_datafmt(mf->code);
+	struct gc0308_mode_info *info;
 
-	if (!fmt) {
-		mf->code	= gc0308_colour_fmts[0].code;
-		mf->colorspace	= gc0308_colour_fmts[0].colorspace;
-	}
+	if (!fmt)
+		fmt = &gc0308_colour_fmts[0];
+
+	mf->code	= fmt->code;
+	mf->colorspace	= fmt->colorspace;
 
+	info = &gc0308_mode_info_data[gc0308_30_fps]
+				     [gc0308_find_mode(mf->width, mf->height)];
+	mf->width	= info->width;
+	mf->height	= info->height;
 	mf->field	= V4L2_FIELD_NONE;
 
 	return 0;
@@ -1010,15 +1966,57 @@ static int gc0308_s_fmt(struct v4l2_subdev *sd,
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct gc0308 *sensor = to_gc0308(client);
+	const struct gc0308_datafmt *fmt;
+	enum gc0308_mode mode;
+	bool switched = false;
+	int ret;
 
 	/* MIPI CSI could have changed the format, double-check */
-	if (!gc0308_find_datafmt(mf->code))
+	fmt = gc0308_find_datafmt(mf->code);
+	if (!fmt)
 		return -EINVAL;
 
+	ret = gc0308_wait_init(sensor);
+	if (ret < 0)
+		return ret;
+
 	gc0308_try_fmt(sd, mf);
-	sensor->fmt = gc0308_find_datafmt(mf->code);
+	mode = gc0308_find_mode(mf->width, mf->height);
+
+	mutex_lock(&sensor->lock);
+	if (mode != sensor->mode ||
+	    sensor->crop.width != GC0308_ARRAY_WIDTH ||
+	    sensor->crop.height != GC0308_ARRAY_HEIGHT) {
+		ret = gc0308_pm_get(sensor);
+		if (ret < 0)
+			goto out;
+
+		ret = gc0308_switch_mode(sensor, mode);
+		switched = true;
+
+		pm_runtime_mark_last_busy(&client->dev);
+		pm_runtime_put_autosuspend(&client->dev);
+		if (ret < 0)
+			goto out;
+	}
 
-	return 0;
+	/* lands in the register cache if the sensor is suspended */
+	ret = gc0308_write_output_fmt(sensor, fmt);
+	if (ret < 0)
+		goto out;
+
+	/* only now is the format what the sensor is programmed with */
+	spin_lock(&sensor->state_lock);
+	sensor->fmt = fmt;
+	sensor->pix.pixelformat = fmt->pixelformat;
+	spin_unlock(&sensor->state_lock);
+out:
+	mutex_unlock(&sensor->lock);
+
+	trace_gc0308_s_fmt(&client->dev, mf->code, mf->width, mf->height, mode,
+			   switched, ret);
+
+	return ret;
 }
 
 static int gc0308_g_fmt(struct v4l2_subdev *sd,
@@ -1026,11 +2024,15 @@ static int gc0308_g_fmt(struct v4l2_subdev *sd,
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct gc0308 *sensor = to_gc0308(client);
+	const struct gc0308_datafmt *fmt;
 
-	const struct gc0308_datafmt *fmt = sensor->fmt;
-
+	spin_lock(&sensor->state_lock);
+	fmt = sensor->fmt;
 	mf->code	= fmt->code;
 	mf->colorspace	= fmt->colorspace;
+	mf->width	= sensor->pix.width;
+	mf->height	= sensor->pix.height;
+	spin_unlock(&sensor->state_lock);
 	mf->field	= V4L2_FIELD_NONE;
 
 	return 0;
@@ -1078,12 +2080,43 @@ static int gc0308_enum_framesizes(struct v4l2_subdev *sd,
  *
  * Return 0 if successful, otherwise -EINVAL.
  */
+/*
+ * Shortest frame interval for the full window: rows at GC0308_HB_MIN and no
+ * vertical blanking, unless the clock is fast enough for MAX_FPS.
+ */
+static void gc0308_min_frame_interval(struct gc0308 *sensor,
+				      struct v4l2_fract *fi)
+{
+	u32 row_clks = GC0308_HB_MIN + GC0308_SH_DELAY_DEF +
+		       GC0308_ARRAY_WIDTH + GC0308_WIN_PAD_W + 4;
+	u32 rows = GC0308_ARRAY_HEIGHT + GC0308_WIN_PAD_H + 8;
+	u32 frame_clks = row_clks * rows;
+	unsigned long div;
+
+	if ((u64)frame_clks * MAX_FPS <= sensor->sys_clk) {
+		fi->numerator = 1;
+		fi->denominator = MAX_FPS;
+		return;
+	}
+
+	div = gcd(frame_clks, sensor->sys_clk);
+	fi->numerator = frame_clks / div;
+	fi->denominator = sensor->sys_clk / div;
+}
+
+/*
+ * Any interval between the fastest the clock allows and 1/MIN_FPS can be
+ * programmed through the blanking, so every size reports one continuous
+ * range.
+ */
 static int gc0308_enum_frameintervals(struct v4l2_subdev *sd,
 		struct v4l2_frmivalenum *fival)
 {
-	int i, j, count;
+	struct gc0308 *sensor = to_gc0308(v4l2_get_subdevdata(sd));
+	struct gc0308_mode_info *info = gc0308_mode_info_data[gc0308_30_fps];
+	int i;
 
-	if (fival->index < 0 || fival->index > gc0308_mode_MAX)
+	if (fival->index != 0)
 		return -EINVAL;
 
 	if (fival->width == 0 || fival->height == 0 ||
@@ -1092,44 +2125,63 @@ static int gc0308_enum_frameintervals(struct v4l2_subdev *sd,
 		return -EINVAL;
 	}
 
-	fival->type = V4L2_FRMIVAL_TYPE_DISCRETE;
-	fival->discrete.numerator = 1;
-
-	count = 0;
-	for (i = 0; i < ARRAY_SIZE(gc0308_mode_info_data); i++) {
-		for (j = 0; j < (gc0308_mode_MAX + 1); j++) {
-			if (fival->pixel_format == gc0308_data.pix.pixelformat
-			 && fival->width == gc0308_mode_info_data[i][j].width
-			 && fival->height == gc0308_mode_info_data[i][j].height
-			 && gc0308_mode_info_data[i][j].init_data_ptr != NULL) {
-				count++;
-			}
-			if (fival->index == (count - 1)) {
-				fival->discrete.denominator =
-						gc0308_framerates[i];
-				return 0;
-			}
-		}
-	}
+	if (!gc0308_find_pixfmt(fival->pixel_format))
+		return -EINVAL;
+
+	for (i = 0; i <= gc0308_mode_MAX; i++)
+		if (fival->width == info[i].width &&
+		    fival->height == info[i].height)
+			break;
+	if (i > gc0308_mode_MAX)
+		return -EINVAL;
+
+	fival->type = V4L2_FRMIVAL_TYPE_CONTINUOUS;
+	gc0308_min_frame_interval(sensor, &fival->stepwise.min);
+	fival->stepwise.max.numerator = 1;
+	fival->stepwise.max.denominator = MIN_FPS;
+	fival->stepwise.step.numerator = 1;
+	fival->stepwise.step.denominator = 1;
 
-	return -EINVAL;
+	return 0;
 }
 
-static int gc0308_set_clk_rate(void)
+static int gc0308_set_clk_rate(struct gc0308 *sensor)
 {
 	u32 tgt_xclk;	/* target xclk */
+	unsigned long rate;
 	int ret;
 
 	/* mclk */
-	tgt_xclk = gc0308_data.mclk;
+	tgt_xclk = sensor->mclk;
 	tgt_xclk = min(tgt_xclk, (u32)GC0308_XCLK_MAX);
 	tgt_xclk = max(tgt_xclk, (u32)GC0308_XCLK_MIN);
-	gc0308_data.mclk = tgt_xclk;
+	sensor->mclk = tgt_xclk;
 
 	pr_debug("   Setting mclk to %d MHz\n", tgt_xclk / 1000000);
-	ret = clk_set_rate(gc0308_data.sensor_clk, gc0308_data.mclk);
+	ret = clk_set_rate(sensor->sensor_clk, sensor->mclk);
 	if (ret < 0)
-		pr_debug("set rate filed, rate=%d\n", gc0308_data.mclk);
+		pr_debug("set rate filed, rate=%d\n", sensor->mclk);
+
+	/* the clock may only get close, time everything from what it gave */
+	rate = clk_get_rate(sensor->sensor_clk);
+	if (rate)
+		sensor->mclk = rate;
+
+	/*
+	 * Run the sensor as fast as the CSI allows: PCLK is MCLK / clk_div, so
+	 * take the smallest divider that keeps it in range. The frame rate is
+	 * set through blanking, so a faster clock only shortens the readout.
+	 */
+	sensor->clk_div = 1;
+	if (sensor->pclk_max)
+		sensor->clk_div = clamp_t(u32, DIV_ROUND_UP(sensor->mclk,
+							    sensor->pclk_max),
+					  1, GC0308_CLK_DIV_MAX);
+	sensor->sys_clk = sensor->mclk / 2 / sensor->clk_div;
+
+	pr_debug("%s: mclk %u Hz, divider %u\n", __func__, sensor->mclk,
+		 sensor->clk_div);
+
 	return ret;
 }
 
@@ -1138,37 +2190,23 @@ static int gc0308_set_clk_rate(void)
  * @s: pointer to standard V4L2 device structure
  *
  */
-static int init_device(void)
+static int init_device(struct gc0308 *sensor)
 {
-	u32 tgt_xclk;	/* target xclk */
-	u32 tgt_fps;	/* target frames per secound */
-	enum gc0308_frame_rate frame_rate;
 	int ret;
 
-	gc0308_data.on = true;
-
-	/* mclk */
-	tgt_xclk = gc0308_data.mclk;
-
 	/* Default camera frame rate is set in probe */
-	tgt_fps = gc0308_data.streamcap.timeperframe.denominator /
-		  gc0308_data.streamcap.timeperframe.numerator;
-
-	if (tgt_fps == 15)
-		frame_rate = gc0308_15_fps;
-	else if (tgt_fps == 30)
-		frame_rate = gc0308_30_fps;
-	else
-		return -EINVAL; /* Only support 15fps or 30fps now. */
-
-	ret = gc0308_init_mode();
+	ret = gc0308_init_mode(sensor, sensor->mode);
 
 	return ret;
 }
 
 static struct v4l2_subdev_video_ops gc0308_subdev_video_ops = {
+	.s_stream = gc0308_s_stream,
 	.g_parm = gc0308_g_parm,
 	.s_parm = gc0308_s_parm,
+	.cropcap = gc0308_cropcap,
+	.g_crop = gc0308_g_crop,
+	.s_crop = gc0308_s_crop,
 
 	.s_mbus_fmt	= gc0308_s_fmt,
 	.g_mbus_fmt	= gc0308_g_fmt,
@@ -1178,8 +2216,295 @@ static struct v4l2_subdev_video_ops gc0308_subdev_video_ops = {
 	.enum_frameintervals = gc0308_enum_frameintervals,
 };
 
+static int gc0308_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct gc0308 *sensor = container_of(ctrl->handler, struct gc0308,
+					     ctrls.handler);
+	struct gc0308_ctrls *ctrls = &sensor->ctrls;
+	struct device *dev = &sensor->i2c_client->dev;
+	u8 vals[3];
+	int ret = 0;
+
+	if (gc0308_wait_init(sensor) < 0)
+		return 0;
+
+	/* a suspended sensor keeps the values it last reported */
+	pm_runtime_get_noresume(dev);
+	if (!pm_runtime_active(dev)) {
+		pm_runtime_put_noidle(dev);
+		return 0;
+	}
+
+	mutex_lock(&sensor->lock);
+	/* nor can it be read before the cached writes have gone out */
+	if (sensor->restore_pending)
+		goto out;
+
+	switch (ctrl->id) {
+	case V4L2_CID_AUTO_WHITE_BALANCE:
+		ret = gc0308_read_regs(sensor,
+				       GC0308_REG(0, GC0308_REG_AWB_R_GAIN),
+				       vals, 3);
+		if (ret < 0)
+			break;
+
+		ctrls->red_balance->val = vals[0];
+		ctrls->blue_balance->val = vals[2];
+		break;
+	case V4L2_CID_EXPOSURE_AUTO:
+		if (!gc0308_aec_enabled(sensor))
+			break;
+
+		ret = gc0308_read_regs(sensor,
+				       GC0308_REG(0, GC0308_REG_EXPOSURE_H),
+				       vals, 2);
+		if (ret < 0)
+			break;
+		ctrls->exposure->val = ((vals[0] & 0x0f) << 8) | vals[1];
+
+		ret = gc0308_read_regs(sensor,
+				       GC0308_REG(0, GC0308_REG_GLOBAL_GAIN),
+				       vals, 1);
+		if (ret < 0)
+			break;
+		ctrls->gain->val = vals[0] & GC0308_GAIN_MAX;
+		break;
+	}
+
+out:
+	mutex_unlock(&sensor->lock);
+	pm_runtime_put_autosuspend(dev);
+
+	return ret;
+}
+
+/*!
+ * gc0308_s_ctrl - apply a control cluster
+ * @ctrl: cluster leader
+ *
+ * The new values are cached in struct gc0308 and written to the sensor. While
+ * the sensor is suspended the writes land in the register cache and reach
+ * the hardware on resume.
+ */
+static int gc0308_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct gc0308 *sensor = container_of(ctrl->handler, struct gc0308,
+					     ctrls.handler);
+	struct gc0308_ctrls *ctrls = &sensor->ctrls;
+	int ret;
+
+	ret = gc0308_wait_init(sensor);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&sensor->lock);
+
+	switch (ctrl->id) {
+	case V4L2_CID_BRIGHTNESS:
+		sensor->brightness = ctrls->brightness->val;
+		sensor->contrast = ctrls->contrast->val;
+		sensor->saturation = ctrls->saturation->val;
+		ret = gc0308_write_image_ctrls(sensor);
+		break;
+	case V4L2_CID_AUTO_WHITE_BALANCE:
+		sensor->auto_wb = ctrls->auto_wb->val;
+		sensor->red = ctrls->red_balance->val;
+		sensor->blue = ctrls->blue_balance->val;
+		ret = gc0308_write_awb(sensor);
+		break;
+	case V4L2_CID_EXPOSURE_AUTO:
+		sensor->ae_mode = ctrls->exposure_auto->val;
+		sensor->autogain = ctrls->autogain->val;
+		sensor->exposure = ctrls->exposure->val;
+		sensor->gain = ctrls->gain->val;
+		ret = gc0308_write_aec(sensor, true);
+		break;
+	case V4L2_CID_TEST_PATTERN:
+		sensor->test_pattern = ctrl->val;
+		ret = gc0308_write_test_pattern(sensor);
+		break;
+	case V4L2_CID_HFLIP:
+		sensor->hflip = ctrls->hflip->val;
+		sensor->vflip = ctrls->vflip->val;
+		ret = gc0308_write_flip(sensor);
+		break;
+	case V4L2_CID_SHARPNESS:
+		sensor->sharpness = ctrl->val;
+		ret = gc0308_write_isp_ctrls(sensor);
+		break;
+	case V4L2_CID_GAMMA:
+		sensor->gamma = ctrl->val;
+		ret = gc0308_write_isp_ctrls(sensor);
+		break;
+	case V4L2_CID_COLORFX:
+		sensor->colorfx = ctrl->val;
+		ret = gc0308_write_isp_ctrls(sensor);
+		break;
+	case V4L2_CID_GC0308_DENOISE:
+		sensor->denoise = ctrl->val;
+		ret = gc0308_write_isp_ctrls(sensor);
+		break;
+	case V4L2_CID_POWER_LINE_FREQUENCY:
+		sensor->power_line = ctrl->val;
+		ret = gc0308_apply_frame_interval(sensor);
+		break;
+	case V4L2_CID_GC0308_MIN_FPS:
+		sensor->min_fps = ctrl->val;
+		ret = gc0308_apply_frame_interval(sensor);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	mutex_unlock(&sensor->lock);
+
+	return ret;
+}
+
+static const struct v4l2_ctrl_ops gc0308_ctrl_ops = {
+	.g_volatile_ctrl = gc0308_g_volatile_ctrl,
+	.s_ctrl = gc0308_s_ctrl,
+};
+
+/* Frames from setting exposure/gain to the first frame showing it */
+static const struct v4l2_ctrl_config gc0308_ctrl_latency = {
+	.id = V4L2_CID_GC0308_CTRL_LATENCY,
+	.name = "Control Latency (frames)",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = GC0308_CTRL_LATENCY,
+	.max = GC0308_CTRL_LATENCY,
+	.step = 1,
+	.def = GC0308_CTRL_LATENCY,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY,
+};
+
+/* Base strength of the bilateral denoise filter */
+static const struct v4l2_ctrl_config gc0308_ctrl_denoise = {
+	.ops = &gc0308_ctrl_ops,
+	.id = V4L2_CID_GC0308_DENOISE,
+	.name = "Noise Reduction",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = GC0308_DENOISE_MAX,
+	.step = 1,
+	.def = 0x08,
+};
+
+/*
+ * Lowest frame rate AEC may drop to in low light. 0 keeps the frame rate
+ * set through s_parm.
+ */
+static const struct v4l2_ctrl_config gc0308_ctrl_min_fps = {
+	.ops = &gc0308_ctrl_ops,
+	.id = V4L2_CID_GC0308_MIN_FPS,
+	.name = "AEC Minimum Frame Rate",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = MAX_FPS,
+	.step = 1,
+	.def = 0,
+};
+
+/*
+ * Control defaults match the register tables, so registering the controls
+ * doesn't touch the sensor.
+ */
+static int gc0308_init_controls(struct gc0308 *sensor)
+{
+	const struct v4l2_ctrl_ops *ops = &gc0308_ctrl_ops;
+	struct gc0308_ctrls *ctrls = &sensor->ctrls;
+	struct v4l2_ctrl_handler *hdl = &ctrls->handler;
+
+	v4l2_ctrl_handler_init(hdl, 20);
+
+	ctrls->brightness = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_BRIGHTNESS,
+					      -128, 127, 1, sensor->brightness);
+	ctrls->contrast = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_CONTRAST,
+					    0, 255, 1, sensor->contrast);
+	ctrls->saturation = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_SATURATION,
+					      0, 255, 1, sensor->saturation);
+
+	ctrls->auto_wb = v4l2_ctrl_new_std(hdl, ops,
+					   V4L2_CID_AUTO_WHITE_BALANCE,
+					   0, 1, 1, sensor->auto_wb);
+	ctrls->red_balance = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_RED_BALANCE,
+					       0, 255, 1, sensor->red);
+	ctrls->blue_balance = v4l2_ctrl_new_std(hdl, ops,
+						V4L2_CID_BLUE_BALANCE,
+						0, 255, 1, sensor->blue);
+
+	ctrls->exposure_auto = v4l2_ctrl_new_std_menu(hdl, ops,
+						      V4L2_CID_EXPOSURE_AUTO,
+						      V4L2_EXPOSURE_MANUAL, 0,
+						      sensor->ae_mode);
+	ctrls->exposure = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_EXPOSURE,
+					    1, GC0308_EXPOSURE_MAX, 1,
+					    sensor->exposure);
+	ctrls->autogain = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_AUTOGAIN,
+					    0, 1, 1, sensor->autogain);
+	ctrls->gain = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_GAIN,
+					0, GC0308_GAIN_MAX, 1, sensor->gain);
+	ctrls->latency = v4l2_ctrl_new_custom(hdl, &gc0308_ctrl_latency, NULL);
+
+	ctrls->test_pattern = v4l2_ctrl_new_std_menu_items(hdl, ops,
+					V4L2_CID_TEST_PATTERN,
+					ARRAY_SIZE(gc0308_test_pattern_menu) - 1,
+					0, 0, gc0308_test_pattern_menu);
+
+	ctrls->hflip = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_HFLIP,
+					 0, 1, 1, sensor->hflip);
+	ctrls->vflip = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_VFLIP,
+					 0, 1, 1, sensor->vflip);
+
+	ctrls->sharpness = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_SHARPNESS,
+					     0, GC0308_SHARPNESS_MAX, 1,
+					     sensor->sharpness);
+	ctrls->gamma = v4l2_ctrl_new_std(hdl, ops, V4L2_CID_GAMMA,
+					 1, ARRAY_SIZE(gc0308_gamma_curves), 1,
+					 sensor->gamma);
+	ctrls->colorfx = v4l2_ctrl_new_std_menu(hdl, ops, V4L2_CID_COLORFX,
+						V4L2_COLORFX_GRASS_GREEN,
+						GC0308_COLORFX_SKIP,
+						sensor->colorfx);
+	ctrls->denoise = v4l2_ctrl_new_custom(hdl, &gc0308_ctrl_denoise, NULL);
+
+	ctrls->power_line = v4l2_ctrl_new_std_menu(hdl, ops,
+					V4L2_CID_POWER_LINE_FREQUENCY,
+					V4L2_CID_POWER_LINE_FREQUENCY_60HZ, 0,
+					sensor->power_line);
+	ctrls->min_fps = v4l2_ctrl_new_custom(hdl, &gc0308_ctrl_min_fps, NULL);
+
+	if (hdl->error) {
+		int ret = hdl->error;
+
+		v4l2_ctrl_handler_free(hdl);
+		return ret;
+	}
+
+	v4l2_ctrl_cluster(3, &ctrls->brightness);
+	v4l2_ctrl_auto_cluster(3, &ctrls->auto_wb, 0, true);
+
+	/* while AEC runs, exposure and gain read back from the sensor */
+	ctrls->exposure->flags |= V4L2_CTRL_FLAG_VOLATILE;
+	ctrls->gain->flags |= V4L2_CTRL_FLAG_VOLATILE;
+	v4l2_ctrl_cluster(4, &ctrls->exposure_auto);
+	v4l2_ctrl_cluster(2, &ctrls->hflip);
+
+	sensor->subdev.ctrl_handler = hdl;
+
+	return 0;
+}
+
 static struct v4l2_subdev_core_ops gc0308_subdev_core_ops = {
 	.s_power	= gc0308_s_power,
+	.queryctrl	= v4l2_subdev_queryctrl,
+	.querymenu	= v4l2_subdev_querymenu,
+	.g_ctrl		= v4l2_subdev_g_ctrl,
+	.s_ctrl		= v4l2_subdev_s_ctrl,
+	.g_ext_ctrls	= v4l2_subdev_g_ext_ctrls,
+	.s_ext_ctrls	= v4l2_subdev_s_ext_ctrls,
+	.try_ext_ctrls	= v4l2_subdev_try_ext_ctrls,
 };
 
 static struct v4l2_subdev_ops gc0308_subdev_ops = {
@@ -1187,21 +2512,13 @@ static struct v4l2_subdev_ops gc0308_subdev_ops = {
 	.video	= &gc0308_subdev_video_ops,
 };
 
-static int get_device_id(void)
+static int get_device_id(struct gc0308 *sensor)
 {
-    u8 au8RegBuf[2] = {0};
     u8 u8RdVal = 0;
-    au8RegBuf[0] = 0x00;
 
-    if (1 != i2c_master_send(gc0308_data.i2c_client, au8RegBuf, 1)) {
-        pr_err("%s:write reg error:reg=%x\n",
-                __func__, 0xfb);
-        return -1;
-    }
-
-    if (1 != i2c_master_recv(gc0308_data.i2c_client, &u8RdVal, 1)) {
-        pr_err("%s:read reg error:reg=%x,val=%x\n",
-                __func__, 0xfb, u8RdVal);
+    if (gc0308_i2c_read(sensor, GC0308_REG_CHIP_ID, &u8RdVal, 1) < 0) {
+        pr_err("%s:read reg error:reg=%x\n",
+                __func__, GC0308_REG_CHIP_ID);
         return -1;
     }
 
@@ -1210,28 +2527,298 @@ static int get_device_id(void)
     return u8RdVal;
 }
 
-static int get_pix_format(void)
+static int get_pix_format(struct gc0308 *sensor)
 {
-    u8 au8RegBuf[2] = {0};
     u8 u8RdVal = 0;
-    au8RegBuf[0] = 0x24;
-
-    if (1 != i2c_master_send(gc0308_data.i2c_client, au8RegBuf, 1)) {
-        pr_err("%s:write reg error:reg=%x\n",
-                __func__, 0xfb);
-        return -1;
-    }
 
-    if (1 != i2c_master_recv(gc0308_data.i2c_client, &u8RdVal, 1)) {
-        pr_err("%s:read reg error:reg=%x,val=%x\n",
-                __func__, 0xfb, u8RdVal);
+    if (gc0308_read_reg(sensor, GC0308_REG_OUTPUT_FMT, &u8RdVal) < 0)
         return -1;
-    }
 
     printk(KERN_INFO "Pix format is %x\n", u8RdVal);
 
     return u8RdVal;
 }
+/* Everything after the presence check: regmap setup and register tables */
+static int gc0308_hw_init(struct gc0308 *sensor)
+{
+	struct gc0308_probe_timing *timing = &sensor->probe_timing;
+	ktime_t start = ktime_get();
+	int retval;
+
+	retval = gc0308_regmap_init(sensor);
+	if (retval < 0)
+		return retval;
+
+	timing->regmap_us = ktime_us_delta(ktime_get(), start);
+
+	get_pix_format(sensor);
+
+	start = ktime_get();
+	retval = init_device(sensor);
+	if (retval < 0)
+		return retval;
+
+	timing->settle_us = sensor->settle_us;
+	timing->download_us = ktime_us_delta(ktime_get(), start) -
+			      timing->settle_us;
+
+	return 0;
+}
+
+static void gc0308_init_work(struct work_struct *work)
+{
+	struct gc0308 *sensor = container_of(work, struct gc0308, init_work);
+	ktime_t start = ktime_get();
+
+	mutex_lock(&sensor->lock);
+	sensor->init_err = gc0308_hw_init(sensor);
+	if (sensor->init_err < 0)
+		pr_warning("camera gc0308 init failed\n");
+	mutex_unlock(&sensor->lock);
+	complete_all(&sensor->init_done);
+
+	/* drop the reference probe took, the sensor can now autosuspend */
+	pm_runtime_mark_last_busy(&sensor->i2c_client->dev);
+	pm_runtime_put_autosuspend(&sensor->i2c_client->dev);
+
+	pr_debug("%s: deferred init took %lld us\n", __func__,
+		 ktime_us_delta(ktime_get(), start));
+}
+
+/*
+ * Runtime suspend gates MCLK and asserts PWDN. Register writes made while
+ * suspended only update the regmap cache.
+ */
+static int __maybe_unused gc0308_runtime_suspend(struct device *dev)
+{
+	struct gc0308 *sensor = to_gc0308(to_i2c_client(dev));
+
+	if (sensor->regmap)
+		regcache_cache_only(sensor->regmap, true);
+
+	gc0308_power_down(sensor, 1);
+	clk_disable_unprepare(sensor->sensor_clk);
+
+	return 0;
+}
+
+/*
+ * The sensor keeps its register file in power down, so resume only has to
+ * bring the clock back and release PWDN. No reset, table download or settle
+ * is needed. Not every resume comes with sensor->lock held (writing "on" to
+ * power/control resumes from sysfs), so the writes cached while suspended
+ * are not replayed here: the regmap stays cache-only and restore_pending
+ * leaves the replay to the next gc0308_pm_get(), under the lock.
+ */
+static int __maybe_unused gc0308_runtime_resume(struct device *dev)
+{
+	struct gc0308 *sensor = to_gc0308(to_i2c_client(dev));
+	int ret;
+
+	ret = clk_prepare_enable(sensor->sensor_clk);
+	if (ret < 0)
+		return ret;
+
+	gc0308_power_down(sensor, 0);
+
+	if (sensor->regmap)
+		sensor->restore_pending = true;
+
+	return 0;
+}
+
+static const struct dev_pm_ops gc0308_pm_ops = {
+	SET_RUNTIME_PM_OPS(gc0308_runtime_suspend, gc0308_runtime_resume,
+			   NULL)
+};
+
+#ifdef CONFIG_DEBUG_FS
+static int gc0308_stats_show(struct seq_file *m, void *unused)
+{
+	static const char * const names[] = { "read", "write" };
+	struct gc0308 *sensor = m->private;
+	struct gc0308_io_stats *stats;
+	int dir, i;
+
+	for (dir = 0; dir < GC0308_IO_DIRS; dir++) {
+		stats = &sensor->io_stats[dir];
+		seq_printf(m, "%s: %llu transfers, %llu bytes, %u errors\n",
+			   names[dir], stats->transfers, stats->bytes,
+			   stats->errors);
+		for (i = 0; i < GC0308_LAT_BUCKETS - 1; i++)
+			seq_printf(m, "  < %4u us: %u\n", 1U << i,
+				   stats->latency[i]);
+		seq_printf(m, "  >=%4u us: %u\n", 1U << i, stats->latency[i]);
+	}
+
+	return 0;
+}
+
+static int gc0308_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, gc0308_stats_show, inode->i_private);
+}
+
+static const struct file_operations gc0308_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = gc0308_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int gc0308_probe_timing_show(struct seq_file *m, void *unused)
+{
+	struct gc0308 *sensor = m->private;
+	struct gc0308_probe_timing *timing = &sensor->probe_timing;
+
+	seq_printf(m, "reset:        %lld us\n", timing->reset_us);
+	seq_printf(m, "chip id:      %lld us\n", timing->chip_id_us);
+	seq_printf(m, "registration: %lld us\n", timing->register_us);
+	seq_printf(m, "regmap:       %lld us\n", timing->regmap_us);
+	seq_printf(m, "download:     %lld us\n", timing->download_us);
+	seq_printf(m, "settle:       %lld us\n", timing->settle_us);
+
+	return 0;
+}
+
+static int gc0308_probe_timing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, gc0308_probe_timing_show, inode->i_private);
+}
+
+static const struct file_operations gc0308_probe_timing_fops = {
+	.owner = THIS_MODULE,
+	.open = gc0308_probe_timing_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * Dump the selected page as read from the sensor, bypassing the regmap
+ * cache, so the dump shows what the hardware actually holds.
+ */
+static int gc0308_regs_show(struct seq_file *m, void *unused)
+{
+	struct gc0308 *sensor = m->private;
+	struct device *dev = &sensor->i2c_client->dev;
+	u8 page = sensor->debugfs_page & GC0308_PAGE_MASK;
+	u8 vals[GC0308_PAGE_REGS];
+	int i, ret;
+
+	ret = gc0308_wait_init(sensor);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&sensor->lock);
+	ret = gc0308_pm_get(sensor);
+	if (ret < 0)
+		goto out;
+
+	regcache_cache_bypass(sensor->regmap, true);
+	ret = gc0308_read_regs(sensor, GC0308_REG(page, 0x00), vals,
+			       GC0308_PAGE_REGS);
+	regcache_cache_bypass(sensor->regmap, false);
+	gc0308_drop_page_cache(sensor);
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+out:
+	mutex_unlock(&sensor->lock);
+	if (ret < 0)
+		return -EIO;
+
+	seq_printf(m, "page %d\n", page);
+	for (i = 0; i < GC0308_PAGE_REGS; i++)
+		seq_printf(m, "%s%02x", i % 16 ? " " : i ? "\n" : "", vals[i]);
+	seq_puts(m, "\n");
+
+	return 0;
+}
+
+static int gc0308_regs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, gc0308_regs_show, inode->i_private);
+}
+
+/* "<reg> <val>" in hex pokes a register of the selected page */
+static ssize_t gc0308_regs_write(struct file *file, const char __user *ubuf,
+				 size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct gc0308 *sensor = m->private;
+	struct device *dev = &sensor->i2c_client->dev;
+	u8 page = sensor->debugfs_page & GC0308_PAGE_MASK;
+	char buf[16] = "";
+	unsigned int reg, val;
+	ssize_t ret;
+
+	ret = simple_write_to_buffer(buf, sizeof(buf) - 1, ppos, ubuf, count);
+	if (ret < 0)
+		return ret;
+
+	if (sscanf(buf, "%x %x", &reg, &val) != 2 ||
+	    reg >= GC0308_PAGE_REGS || val > 0xff)
+		return -EINVAL;
+
+	ret = gc0308_wait_init(sensor);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&sensor->lock);
+	ret = gc0308_pm_get(sensor);
+	if (ret < 0)
+		goto out;
+
+	/* through the cache, so the driver sees the poked value too */
+	ret = regmap_write(sensor->regmap, GC0308_REG(page, reg), val);
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+out:
+	mutex_unlock(&sensor->lock);
+
+	return ret < 0 ? ret : count;
+}
+
+static const struct file_operations gc0308_regs_fops = {
+	.owner = THIS_MODULE,
+	.open = gc0308_regs_open,
+	.read = seq_read,
+	.write = gc0308_regs_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* gc0308-<bus>-<addr>/ with the bus stats, probe timing and register access */
+static void gc0308_debugfs_init(struct gc0308 *sensor)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "gc0308-%s",
+		 dev_name(&sensor->i2c_client->dev));
+	sensor->debugfs = debugfs_create_dir(name, NULL);
+
+	debugfs_create_file("stats", 0444, sensor->debugfs, sensor,
+			    &gc0308_stats_fops);
+	debugfs_create_file("probe_timing", 0444, sensor->debugfs, sensor,
+			    &gc0308_probe_timing_fops);
+	debugfs_create_u8("page", 0644, sensor->debugfs,
+			  &sensor->debugfs_page);
+	debugfs_create_file("registers", 0644, sensor->debugfs, sensor,
+			    &gc0308_regs_fops);
+}
+
+static void gc0308_debugfs_exit(struct gc0308 *sensor)
+{
+	debugfs_remove_recursive(sensor->debugfs);
+}
+#else
+static inline void gc0308_debugfs_init(struct gc0308 *sensor) {}
+static inline void gc0308_debugfs_exit(struct gc0308 *sensor) {}
+#endif
+
 /*!
  * gc0308 I2C probe function
  *
@@ -1243,8 +2830,14 @@ static int gc0308_probe(struct i2c_client *client,
 {
 	struct pinctrl *pinctrl;
 	struct device *dev = &client->dev;
+	struct gc0308 *sensor;
+	ktime_t start;
 	int retval;
 
+	sensor = devm_kzalloc(dev, sizeof(*sensor), GFP_KERNEL);
+	if (!sensor)
+		return -ENOMEM;
+
 	/* gc0308 pinctrl */
 	pinctrl = devm_pinctrl_get_select_default(dev);
 	if (IS_ERR(pinctrl)) {
@@ -1253,104 +2846,183 @@ static int gc0308_probe(struct i2c_client *client,
 	}
 
 	/* request power down pin */
-	pwn_gpio = of_get_named_gpio(dev->of_node, "pwn-gpios", 0);
-	if (!gpio_is_valid(pwn_gpio)) {
+	sensor->pwn_gpio = of_get_named_gpio(dev->of_node, "pwn-gpios", 0);
+	if (!gpio_is_valid(sensor->pwn_gpio)) {
 		dev_err(dev, "no sensor pwdn pin available\n");
 		return -ENODEV;
 	}
-	retval = devm_gpio_request_one(dev, pwn_gpio, GPIOF_OUT_INIT_HIGH,
+	retval = devm_gpio_request_one(dev, sensor->pwn_gpio,
+					GPIOF_OUT_INIT_HIGH,
 					"gc0308_pwdn");
 	if (retval < 0)
 		return retval;
 
 	/* request reset pin */
-	rst_gpio = of_get_named_gpio(dev->of_node, "rst-gpios", 0);
-	if (!gpio_is_valid(rst_gpio)) {
+	sensor->rst_gpio = of_get_named_gpio(dev->of_node, "rst-gpios", 0);
+	if (!gpio_is_valid(sensor->rst_gpio)) {
 		dev_err(dev, "no sensor reset pin available\n");
 		return -EINVAL;
 	}
-	retval = devm_gpio_request_one(dev, rst_gpio, GPIOF_OUT_INIT_HIGH,
+	retval = devm_gpio_request_one(dev, sensor->rst_gpio,
+					GPIOF_OUT_INIT_HIGH,
 					"gc0308_reset");
 	if (retval < 0)
 		return retval;
 
 	/* Set initial values for the sensor struct. */
-	memset(&gc0308_data, 0, sizeof(gc0308_data));
-	gc0308_data.sensor_clk = devm_clk_get(dev, "csi_mclk");
-	if (IS_ERR(gc0308_data.sensor_clk)) {
+	sensor->sensor_clk = devm_clk_get(dev, "csi_mclk");
+	if (IS_ERR(sensor->sensor_clk)) {
 		dev_err(dev, "get mclk failed\n");
-		return PTR_ERR(gc0308_data.sensor_clk);
+		return PTR_ERR(sensor->sensor_clk);
 	}
 
 	retval = of_property_read_u32(dev->of_node, "mclk",
-					&gc0308_data.mclk);
+					&sensor->mclk);
 	if (retval) {
 		dev_err(dev, "mclk frequency is invalid\n");
 		return retval;
 	}
 
 	retval = of_property_read_u32(dev->of_node, "mclk_source",
-					(u32 *) &(gc0308_data.mclk_source));
+					(u32 *) &(sensor->mclk_source));
 	if (retval) {
 		dev_err(dev, "mclk_source invalid\n");
 		return retval;
 	}
 
 	retval = of_property_read_u32(dev->of_node, "csi_id",
-					&(gc0308_data.csi));
+					&(sensor->csi));
 	if (retval) {
 		dev_err(dev, "csi_id invalid\n");
 		return retval;
 	}
 
-	/* Set mclk rate before clk on */
-	gc0308_set_clk_rate();
-
-	clk_prepare_enable(gc0308_data.sensor_clk);
+	/* optional, the CSI input limit */
+	of_property_read_u32(dev->of_node, "pclk-max", &sensor->pclk_max);
 
-	gc0308_data.io_init = gc0308_reset;
-	gc0308_data.i2c_client = client;
-	gc0308_data.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-	gc0308_data.pix.width = 640;
-	gc0308_data.pix.height = 480;
-	gc0308_data.streamcap.capability = V4L2_MODE_HIGHQUALITY |
+	/* Set mclk rate before clk on */
+	gc0308_set_clk_rate(sensor);
+
+	clk_prepare_enable(sensor->sensor_clk);
+
+	sensor->io_init = gc0308_reset;
+	sensor->i2c_client = client;
+	sensor->fmt = &gc0308_colour_fmts[0];
+	sensor->mode = gc0308_mode_VGA_640_480;
+	sensor->crop.width = GC0308_ARRAY_WIDTH;
+	sensor->crop.height = GC0308_ARRAY_HEIGHT;
+	sensor->pix.pixelformat = V4L2_PIX_FMT_YUYV;
+	sensor->pix.width = 640;
+	sensor->pix.height = 480;
+	sensor->streamcap.capability = V4L2_MODE_HIGHQUALITY |
 					   V4L2_CAP_TIMEPERFRAME;
-	gc0308_data.streamcap.capturemode = 0;
-	gc0308_data.streamcap.timeperframe.denominator = DEFAULT_FPS;
-	gc0308_data.streamcap.timeperframe.numerator = 1;
-
-	gc0308_reset();
-
-	gc0308_power_down(0);
-
-	if( get_device_id() == -1 )
+	sensor->streamcap.capturemode = 0;
+	sensor->streamcap.timeperframe.denominator = DEFAULT_FPS;
+	sensor->streamcap.timeperframe.numerator = 1;
+	sensor->frame_interval = sensor->streamcap.timeperframe;
+	/* control defaults, as set up by gc0308_default_setting */
+	sensor->brightness = 0;
+	sensor->contrast = 0x40;
+	sensor->saturation = 0x40;
+	sensor->auto_wb = 1;
+	sensor->red = 0x56;
+	sensor->green = 0x40;
+	sensor->blue = 0x4a;
+	sensor->ae_mode = V4L2_EXPOSURE_AUTO;
+	sensor->autogain = 1;
+	sensor->exposure = 0x258;
+	sensor->gain = 0x14;
+	sensor->sharpness = 4;
+	sensor->gamma = GC0308_GAMMA_DEF;
+	sensor->colorfx = V4L2_COLORFX_NONE;
+	sensor->denoise = gc0308_ctrl_denoise.def;
+	sensor->power_line = V4L2_CID_POWER_LINE_FREQUENCY_50HZ;
+
+	start = ktime_get();
+	gc0308_reset(sensor);
+
+	gc0308_power_down(sensor, 0);
+	sensor->probe_timing.reset_us = ktime_us_delta(ktime_get(), start);
+
+	start = ktime_get();
+	if( get_device_id(sensor) == -1 )
     {
-        clk_disable_unprepare(gc0308_data.sensor_clk);
+        clk_disable_unprepare(sensor->sensor_clk);
         printk(KERN_ERR "get_device_id: error, not GC0308");
         return -1;
     }
+	sensor->probe_timing.chip_id_us = ktime_us_delta(ktime_get(), start);
 
-    get_pix_format();
+	mutex_init(&sensor->lock);
+	spin_lock_init(&sensor->state_lock);
+	INIT_WORK(&sensor->init_work, gc0308_init_work);
+	INIT_DELAYED_WORK(&sensor->gain_work, gc0308_gain_work);
+	init_completion(&sensor->init_done);
 
-	retval = init_device();
-	if (retval < 0) {
-		clk_disable_unprepare(gc0308_data.sensor_clk);
-		pr_warning("camera gc0308 init failed\n");
-		gc0308_power_down(1);
-		return retval;
-	}
+	/* the sensor is powered; probe holds a reference until it's set up */
+	pm_runtime_set_active(dev);
+	pm_runtime_get_noresume(dev);
+	pm_runtime_set_autosuspend_delay(dev, autosuspend_delay_ms);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_enable(dev);
 
-	clk_disable(gc0308_data.sensor_clk);
+	start = ktime_get();
+	v4l2_i2c_subdev_init(&sensor->subdev, client, &gc0308_subdev_ops);
 
-	v4l2_i2c_subdev_init(&gc0308_data.subdev, client, &gc0308_subdev_ops);
+	retval = gc0308_init_controls(sensor);
+	if (retval < 0) {
+		dev_err(&client->dev, "%s--control setup failed, ret=%d\n",
+			__func__, retval);
+		goto err_pm;
+	}
 
-	retval = v4l2_async_register_subdev(&gc0308_data.subdev);
-	if (retval < 0)
+	retval = v4l2_async_register_subdev(&sensor->subdev);
+	if (retval < 0) {
 		dev_err(&client->dev,
 					"%s--Async register failed, ret=%d\n", __func__, retval);
+		goto err_ctrls;
+	}
+	sensor->probe_timing.register_us = ktime_us_delta(ktime_get(), start);
+
+	gc0308_debugfs_init(sensor);
+
+	/*
+	 * The sensor is present: with async_init the register setup and the
+	 * settle wait run from a worker, so probe (and boot) doesn't wait for
+	 * them. Ops that need the sensor programmed wait for the worker.
+	 */
+	if (async_init) {
+		schedule_work(&sensor->init_work);
+	} else {
+		mutex_lock(&sensor->lock);
+		retval = gc0308_hw_init(sensor);
+		sensor->init_err = retval;
+		mutex_unlock(&sensor->lock);
+		complete_all(&sensor->init_done);
+		if (retval < 0) {
+			pr_warning("camera gc0308 init failed\n");
+			gc0308_debugfs_exit(sensor);
+			v4l2_async_unregister_subdev(&sensor->subdev);
+			goto err_ctrls;
+		}
+
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+	}
 
 	pr_info("camera gc0308, is found\n");
 	return retval;
+
+err_ctrls:
+	v4l2_ctrl_handler_free(&sensor->ctrls.handler);
+err_pm:
+	pm_runtime_disable(dev);
+	pm_runtime_set_suspended(dev);
+	pm_runtime_put_noidle(dev);
+	pm_runtime_dont_use_autosuspend(dev);
+	gc0308_power_down(sensor, 1);
+	clk_disable_unprepare(sensor->sensor_clk);
+	return retval;
 }
 
 /*!
@@ -1362,12 +3034,22 @@ static int gc0308_probe(struct i2c_client *client,
 static int gc0308_remove(struct i2c_client *client)
 {
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
+	struct gc0308 *sensor = to_gc0308(client);
 
+	gc0308_debugfs_exit(sensor);
 	v4l2_async_unregister_subdev(sd);
 
-	clk_unprepare(gc0308_data.sensor_clk);
+	flush_work(&sensor->init_work);
+	cancel_delayed_work_sync(&sensor->gain_work);
+	v4l2_ctrl_handler_free(&sensor->ctrls.handler);
 
-	gc0308_power_down(1);
+	pm_runtime_disable(&client->dev);
+	if (!pm_runtime_status_suspended(&client->dev)) {
+		gc0308_power_down(sensor, 1);
+		clk_disable_unprepare(sensor->sensor_clk);
+	}
+	pm_runtime_set_suspended(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
 
 	return 0;
 }
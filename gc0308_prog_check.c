@@ -0,0 +1,572 @@
+/*
+ * Copyright (C) 2012-2015 Freescale Semiconductor, Inc. All Rights Reserved.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Host-side check of the compiled register programs in gc0308_setting.h.
+ *
+ * The driver used to download the vendor tables below as they came: one
+ * {reg, val} write at a time, with 0xfe writes switching the page. The
+ * programs that replaced them write each register once, page by page, in
+ * ascending order. This tool replays both on a model of the two register
+ * pages and checks that they leave the same values behind, and lists the
+ * registers whose write order changed.
+ *
+ *   cc -Wall -o gc0308_prog_check gc0308_prog_check.c
+ *   ./gc0308_prog_check [-v] [-g]
+ *
+ * -v lists every pair of registers written in a different order, -g prints
+ * the programs compiled from the vendor tables in gc0308_setting.h format.
+ * Exit status is 0 when every program matches its vendor table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef unsigned char u8;
+
+#include "gc0308_setting.h"
+
+#define PAGE_REG	0xfe
+#define NREGS		(2 * 256)
+#define KEY(page, reg)	(((page) << 8) | (reg))
+
+struct reg_value {
+	u8 u8RegAddr;
+	u8 u8Val;
+};
+
+/* The vendor tables, as the driver carried them before they were compiled */
+static const struct reg_value vendor_default_setting[] = {
+    {0xfe,0x00},
+    //MCLK=24MHz 10fps
+    {0x0f,0x05},     //0x00
+    {0x01,0xe1},   //0x6a
+    {0x02,0x70},   //0x70
+    {0xe2,0x00},
+    {0xe3,0x96},
+    {0xe4,0x02},
+    {0xe5,0x58},
+    {0xe6,0x02},
+    {0xe7,0x58},
+    {0xe8,0x02},
+    {0xe9,0x58},
+    {0xea,0x0e},
+    {0xeb,0xa6},
+    {0xfe,0x00},
+    {0xec,0x20},
+    {0x05,0x00},
+    {0x06,0x00},
+    {0x07,0x00},
+    {0x08,0x00},
+    {0x09,0x01},
+    {0x0a,0xe8},
+    {0x0b,0x02},
+    {0x0c,0x88},
+    {0x0d,0x02},
+    {0x0e,0x02},
+    {0x10,0x26},
+    {0x11,0x0d},
+    {0x12,0x2a},
+    {0x13,0x00},
+    {0x14,0x11},
+    {0x15,0x0a},
+    {0x16,0x05},
+    {0x17,0x01},
+    {0x18,0x44},
+    {0x19,0x44},
+    {0x1a,0x2a},
+    {0x1b,0x00},
+    {0x1c,0x49},
+    {0x1d,0x9a},
+    {0x1e,0x61},
+    {0x1f,0x00},  //pad drv <=24MHz, use 0x00 is ok
+    {0x20,0x7f},
+    {0x21,0xfa},
+    {0x22,0x57},
+    {0x24,0xa2},    //YCbYCr
+    {0x25,0x0f},
+    {0x26,0x03}, // 0x01
+    {0x28,0x00},
+    {0x2d,0x0a},
+    {0x2f,0x01},
+    {0x30,0xf7},
+    {0x31,0x50},
+    {0x32,0x00},
+    {0x33,0x28},
+    {0x34,0x2a},
+    {0x35,0x28},
+    {0x39,0x04},
+    {0x3a,0x20},
+    {0x3b,0x20},
+    {0x3c,0x00},
+    {0x3d,0x00},
+    {0x3e,0x00},
+    {0x3f,0x00},
+    {0x50,0x14}, // 0x14
+    {0x52,0x41},
+    {0x53,0x80},
+    {0x54,0x80},
+    {0x55,0x80},
+    {0x56,0x80},
+    {0x8b,0x20},
+    {0x8c,0x20},
+    {0x8d,0x20},
+    {0x8e,0x14},
+    {0x8f,0x10},
+    {0x90,0x14},
+    {0x91,0x3c},
+    {0x92,0x50},
+    //{0x8b,0x10},
+    //{0x8c,0x10},
+    //{0x8d,0x10},
+    //{0x8e,0x10},
+    //{0x8f,0x10},
+    //{0x90,0x10},
+    //{0x91,0x3c},
+    //{0x92,0x50},
+    {0x5d,0x12},
+    {0x5e,0x1a},
+    {0x5f,0x24},
+    {0x60,0x07},
+    {0x61,0x15},
+    {0x62,0x08}, // 0x08
+    {0x64,0x03},  // 0x03
+    {0x66,0xe8},
+    {0x67,0x86},
+    {0x68,0x82},
+    {0x69,0x18},
+    {0x6a,0x0f},
+    {0x6b,0x00},
+    {0x6c,0x5f},
+    {0x6d,0x8f},
+    {0x6e,0x55},
+    {0x6f,0x38},
+    {0x70,0x15},
+    {0x71,0x33},
+    {0x72,0xdc},
+    {0x73,0x00},
+    {0x74,0x02},
+    {0x75,0x3f},
+    {0x76,0x02},
+    {0x77,0x38}, // 0x47
+    {0x78,0x88},
+    {0x79,0x81},
+    {0x7a,0x81},
+    {0x7b,0x22},
+    {0x7c,0xff},
+    {0x93,0x48},  //color matrix default
+    {0x94,0x02},
+    {0x95,0x07},
+    {0x96,0xe0},
+    {0x97,0x40},
+    {0x98,0xf0},
+    {0xb1,0x40},
+    {0xb2,0x40},
+    {0xb3,0x40}, //0x40
+    {0xb6,0xe0},
+    {0xbd,0x38},
+    {0xbe,0x36},
+    {0xd0,0xCB},
+    {0xd1,0x10},
+    {0xd2,0x90},
+    {0xd3,0x48},
+    {0xd5,0xF2},
+    {0xd6,0x16},
+    {0xdb,0x92},
+    {0xdc,0xA5},
+    {0xdf,0x23},
+    {0xd9,0x00},
+    {0xda,0x00},
+    {0xe0,0x09},
+    {0xed,0x04},
+    {0xee,0xa0},
+    {0xef,0x40},
+    {0x80,0x03},
+
+    {0x9F,0x10},
+    {0xA0,0x20},
+    {0xA1,0x38},
+    {0xA2,0x4e},
+    {0xA3,0x63},
+    {0xA4,0x76},
+    {0xA5,0x87},
+    {0xA6,0xa2},
+    {0xA7,0xb8},
+    {0xA8,0xca},
+    {0xA9,0xd8},
+    {0xAA,0xe3},
+    {0xAB,0xeb},
+    {0xAC,0xf0},
+    {0xAD,0xF8},
+    {0xAE,0xFd},
+    {0xAF,0xFF},
+
+    {0xc0,0x00},
+    {0xc1,0x10},
+    {0xc2,0x1c},
+    {0xc3,0x30},
+    {0xc4,0x43},
+    {0xc5,0x54},
+    {0xc6,0x65},
+    {0xc7,0x75},
+    {0xc8,0x93},
+    {0xc9,0xB0},
+    {0xca,0xCB},
+    {0xcb,0xE6},
+    {0xcc,0xFF},
+    {0xf0,0x02},
+    {0xf1,0x01},
+    {0xf2,0x02},
+    {0xf3,0x30},
+    {0xf7,0x12},
+    {0xf8,0x0a},
+    {0xf9,0x9f},
+    {0xfa,0x78},
+    {0xfe,0x01},
+    {0x00,0xf5},
+    {0x02,0x20},
+    {0x04,0x10},
+    {0x05,0x08},
+    {0x06,0x20},
+    {0x08,0x0a},
+    {0x0a,0xa0},
+    {0x0b,0x60},
+    {0x0c,0x08},
+    {0x0e,0x44},
+    {0x0f,0x32},
+    {0x10,0x41},
+    {0x11,0x37},
+    {0x12,0x22},
+    {0x13,0x19},
+    {0x14,0x44},
+    {0x15,0x44},
+    {0x16,0xc2},
+    {0x17,0xA8},
+    {0x18,0x18},
+    {0x19,0x50},
+    {0x1a,0xd8},
+    {0x1b,0xf5},
+    {0x70,0x40},
+    {0x71,0x58},
+    {0x72,0x30},
+    {0x73,0x48},
+    {0x74,0x20},
+    {0x75,0x60},
+    {0x77,0x20},
+    {0x78,0x32},
+    {0x30,0x03},
+    {0x31,0x40},
+    {0x32,0x10},
+    {0x33,0xe0},
+    {0x34,0xe0},
+    {0x35,0x00},
+    {0x36,0x80},
+    {0x37,0x00},
+    {0x38,0x04},
+    {0x39,0x09},
+    {0x3a,0x12},
+    {0x3b,0x1C},
+    {0x3c,0x28},
+    {0x3d,0x31},
+    {0x3e,0x44},
+    {0x3f,0x57},
+    {0x40,0x6C},
+    {0x41,0x81},
+    {0x42,0x94},
+    {0x43,0xA7},
+    {0x44,0xB8},
+    {0x45,0xD6},
+    {0x46,0xEE},
+    {0x47,0x0d},
+    {0x62,0xf7},
+    {0x63,0x68},
+    {0x64,0xd3},
+    {0x65,0xd3},
+    {0x66,0x60},
+    {0xfe,0x00},
+};
+
+static const struct reg_value vendor_setting_VGA_640_480[] = {
+    {0xfe,0x01},
+    {0x53,0x82},    // subsample enable
+    {0x54,0x11},    // 1/1
+    {0x55,0x03},
+    {0x56,0x00},
+    {0x57,0x00},
+    {0x58,0x00},
+    {0x59,0x00},
+    {0xfe,0x00},
+    {0x46,0x00},    // crop off
+};
+
+static const struct reg_value vendor_setting_QVGA_320_240[] = {
+    {0xfe,0x01},
+    {0x53,0x82},
+    {0x54,0x22},    // 1/2
+    {0x55,0x03},
+    {0x56,0x00},
+    {0x57,0x00},
+    {0x58,0x00},
+    {0x59,0x00},
+    {0xfe,0x00},
+    {0x46,0x80},    // crop 320x240 at 0,0
+    {0x47,0x00},
+    {0x48,0x00},
+    {0x49,0x00},
+    {0x4a,0xf0},
+    {0x4b,0x01},
+    {0x4c,0x40},
+};
+
+static const struct reg_value vendor_setting_QQVGA_160_120[] = {
+    {0xfe,0x01},
+    {0x53,0x82},
+    {0x54,0x44},    // 1/4
+    {0x55,0x03},
+    {0x56,0x00},
+    {0x57,0x00},
+    {0x58,0x00},
+    {0x59,0x00},
+    {0xfe,0x00},
+    {0x46,0x80},    // crop 160x120 at 0,0
+    {0x47,0x00},
+    {0x48,0x00},
+    {0x49,0x00},
+    {0x4a,0x78},
+    {0x4b,0x00},
+    {0x4c,0xa0},
+};
+
+static const struct reg_value vendor_setting_CIF_352_288[] = {
+    {0xfe,0x01},
+    {0x53,0x82},
+    {0x54,0x11},    // 1/1
+    {0x55,0x03},
+    {0x56,0x00},
+    {0x57,0x00},
+    {0x58,0x00},
+    {0x59,0x00},
+    {0xfe,0x00},
+    {0x46,0x80},    // crop 352x288 centred at 144,96
+    {0x47,0x60},
+    {0x48,0x90},
+    {0x49,0x01},
+    {0x4a,0x20},
+    {0x4b,0x01},
+    {0x4c,0x60},
+};
+
+#define TABLE(name)							\
+	{ #name, vendor_##name,						\
+	  sizeof(vendor_##name) / sizeof(vendor_##name[0]), gc0308_##name }
+
+static const struct table {
+	const char *name;
+	const struct reg_value *vendor;
+	int len;
+	const u8 *prog;
+} tables[] = {
+	TABLE(default_setting),
+	TABLE(setting_VGA_640_480),
+	TABLE(setting_QVGA_320_240),
+	TABLE(setting_QQVGA_160_120),
+	TABLE(setting_CIF_352_288),
+};
+
+/*
+ * Register state after a download: val[] is the last value written, or -1,
+ * and seq[] is the position of that last write in the download.
+ */
+struct state {
+	int val[NREGS];
+	int seq[NREGS];
+};
+
+static void state_init(struct state *s)
+{
+	int i;
+
+	for (i = 0; i < NREGS; i++) {
+		s->val[i] = -1;
+		s->seq[i] = -1;
+	}
+}
+
+static int replay_vendor(const struct table *t, struct state *s)
+{
+	int i, page = 0, n = 0;
+
+	state_init(s);
+	for (i = 0; i < t->len; i++) {
+		u8 reg = t->vendor[i].u8RegAddr;
+		u8 val = t->vendor[i].u8Val;
+
+		if (reg == 0xff && val == 0xff)		/* end marker */
+			continue;
+		if (reg == PAGE_REG) {
+			if (val & ~0x01) {
+				printf("%s: entry %d writes 0x%02x to 0xfe\n",
+				       t->name, i, val);
+				return -1;
+			}
+			page = val;
+			continue;
+		}
+		s->val[KEY(page, reg)] = val;
+		s->seq[KEY(page, reg)] = n++;
+	}
+	return 0;
+}
+
+static int replay_prog(const struct table *t, struct state *s)
+{
+	const u8 *p = t->prog;
+	int n = 0;
+
+	state_init(s);
+	while (*p != GC0308_PROG_END) {
+		int page = GC0308_RUN_PAGE(p[0]);
+		int len = GC0308_RUN_LEN(p[0]);
+		int reg = p[1], i;
+
+		p += 2;
+		if (len > GC0308_BURST_LEN || reg + len > 0x100 ||
+		    (reg <= PAGE_REG && reg + len > PAGE_REG)) {
+			printf("%s: bad run %d:0x%02x+%d\n",
+			       t->name, page, reg, len);
+			return -1;
+		}
+		for (i = 0; i < len; i++, p++) {
+			if (s->val[KEY(page, reg + i)] >= 0) {
+				printf("%s: %d:0x%02x written twice\n",
+				       t->name, page, reg + i);
+				return -1;
+			}
+			s->val[KEY(page, reg + i)] = *p;
+			s->seq[KEY(page, reg + i)] = n++;
+		}
+	}
+	return 0;
+}
+
+static int compare(const struct table *t, int verbose)
+{
+	struct state v, p;
+	int a, b, regs = 0, diffs = 0, swaps = 0;
+
+	if (replay_vendor(t, &v) || replay_prog(t, &p))
+		return -1;
+
+	for (a = 0; a < NREGS; a++) {
+		if (v.val[a] >= 0)
+			regs++;
+		if (v.val[a] == p.val[a])
+			continue;
+		printf("%s: %d:0x%02x vendor %d, program %d\n", t->name,
+		       a >> 8, a & 0xff, v.val[a], p.val[a]);
+		diffs++;
+	}
+	if (diffs)
+		return -1;
+
+	/* Pairs whose final writes now happen the other way round */
+	for (a = 0; a < NREGS; a++) {
+		for (b = 0; b < NREGS; b++) {
+			if (v.seq[a] < 0 || v.seq[b] < 0 ||
+			    v.seq[a] >= v.seq[b] || p.seq[a] < p.seq[b])
+				continue;
+			if (verbose)
+				printf("%s: %d:0x%02x now after %d:0x%02x\n",
+				       t->name, a >> 8, a & 0xff,
+				       b >> 8, b & 0xff);
+			swaps++;
+		}
+	}
+
+	printf("%s: %d entries -> %d registers, same final state, "
+	       "%d pairs reordered\n", t->name, t->len, regs, swaps);
+	return 0;
+}
+
+/* Print the program for a vendor table, laid out as in gc0308_setting.h */
+static void generate(const struct table *t)
+{
+	struct state v;
+	int page, reg, len, i, col, val;
+
+	if (replay_vendor(t, &v))
+		return;
+
+	printf("static const u8 gc0308_%s[] = {\n", t->name);
+	for (page = 0; page < 2; page++) {
+		printf("\t/* page %d */\n", page);
+		for (reg = 0; reg < 0x100; reg += len) {
+			len = 0;
+			while (reg + len < 0x100 && len < GC0308_BURST_LEN &&
+			       v.val[KEY(page, reg + len)] >= 0)
+				len++;
+			if (!len) {
+				len = 1;
+				continue;
+			}
+			printf("\tGC0308_RUN(%d, 0x%02x, %d),", page, reg, len);
+			/* short runs stay on the header line */
+			col = len <= 8 ? 1 : 0;
+			for (i = 0; i < len; i++) {
+				val = v.val[KEY(page, reg + i)];
+				if (!col && i % 8 == 0)
+					printf("\n\t\t0x%02x,", val);
+				else
+					printf(" 0x%02x,", val);
+			}
+			printf("\n");
+		}
+	}
+	printf("\tGC0308_PROG_END,\n};\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	int i, opt, verbose = 0, gen = 0, ret = 0;
+
+	while ((opt = getopt(argc, argv, "vg")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 'g':
+			gen = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [-g]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	for (i = 0; i < (int)(sizeof(tables) / sizeof(tables[0])); i++) {
+		if (gen)
+			generate(&tables[i]);
+		else if (compare(&tables[i], verbose))
+			ret = 1;
+	}
+	return ret;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2012-2015 Freescale Semiconductor, Inc. All Rights Reserved.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * GC0308 register programs. Only the driver and gc0308_prog_check.c include
+ * this file; the checker holds the vendor tables these were compiled from
+ * and checks that both leave the sensor in the same state.
+ */
+#ifndef GC0308_SETTING_H
+#define GC0308_SETTING_H
+
+/* Max auto-increment bytes per burst write */
+#define GC0308_BURST_LEN	32
+
+/*
+ * Register programs: the vendor tables compiled into page-grouped runs of
+ * consecutive registers, each register written once with its final value.
+ * A run is a GC0308_RUN(page, reg, len) header followed by len values, and
+ * GC0308_PROG_END closes the program. Runs are at most GC0308_BURST_LEN
+ * long, so the downloader sends each one as a single burst.
+ */
+#define GC0308_RUN(page, reg, len)	(((page) << 7) | (len)), (reg)
+#define GC0308_RUN_PAGE(hdr)		((hdr) >> 7)
+#define GC0308_RUN_LEN(hdr)		((hdr) & 0x7f)
+#define GC0308_PROG_END			0
+
+/* Vendor initial setup for MCLK=24MHz, YCbYCr output */
+static const u8 gc0308_default_setting[] = {
+	/* page 0 */
+	GC0308_RUN(0, 0x01, 2), 0xe1, 0x70,
+	GC0308_RUN(0, 0x05, 30),
+		0x00, 0x00, 0x00, 0x00, 0x01, 0xe8, 0x02, 0x88,
+		0x02, 0x02, 0x05, 0x26, 0x0d, 0x2a, 0x00, 0x11,
+		0x0a, 0x05, 0x01, 0x44, 0x44, 0x2a, 0x00, 0x49,
+		0x9a, 0x61, 0x00, 0x7f, 0xfa, 0x57,
+	GC0308_RUN(0, 0x24, 3), 0xa2, 0x0f, 0x03,
+	GC0308_RUN(0, 0x28, 1), 0x00,
+	GC0308_RUN(0, 0x2d, 1), 0x0a,
+	GC0308_RUN(0, 0x2f, 7), 0x01, 0xf7, 0x50, 0x00, 0x28, 0x2a, 0x28,
+	GC0308_RUN(0, 0x39, 7), 0x04, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00,
+	GC0308_RUN(0, 0x50, 1), 0x14,
+	GC0308_RUN(0, 0x52, 5), 0x41, 0x80, 0x80, 0x80, 0x80,
+	GC0308_RUN(0, 0x5d, 6), 0x12, 0x1a, 0x24, 0x07, 0x15, 0x08,
+	GC0308_RUN(0, 0x64, 1), 0x03,
+	GC0308_RUN(0, 0x66, 23),
+		0xe8, 0x86, 0x82, 0x18, 0x0f, 0x00, 0x5f, 0x8f,
+		0x55, 0x38, 0x15, 0x33, 0xdc, 0x00, 0x02, 0x3f,
+		0x02, 0x38, 0x88, 0x81, 0x81, 0x22, 0xff,
+	GC0308_RUN(0, 0x80, 1), 0x03,
+	GC0308_RUN(0, 0x8b, 14),
+		0x20, 0x20, 0x20, 0x14, 0x10, 0x14, 0x3c, 0x50,
+		0x48, 0x02, 0x07, 0xe0, 0x40, 0xf0,
+	GC0308_RUN(0, 0x9f, 17),
+		0x10, 0x20, 0x38, 0x4e, 0x63, 0x76, 0x87, 0xa2,
+		0xb8, 0xca, 0xd8, 0xe3, 0xeb, 0xf0, 0xf8, 0xfd,
+		0xff,
+	GC0308_RUN(0, 0xb1, 3), 0x40, 0x40, 0x40,
+	GC0308_RUN(0, 0xb6, 1), 0xe0,
+	GC0308_RUN(0, 0xbd, 2), 0x38, 0x36,
+	GC0308_RUN(0, 0xc0, 13),
+		0x00, 0x10, 0x1c, 0x30, 0x43, 0x54, 0x65, 0x75,
+		0x93, 0xb0, 0xcb, 0xe6, 0xff,
+	GC0308_RUN(0, 0xd0, 4), 0xcb, 0x10, 0x90, 0x48,
+	GC0308_RUN(0, 0xd5, 2), 0xf2, 0x16,
+	GC0308_RUN(0, 0xd9, 4), 0x00, 0x00, 0x92, 0xa5,
+	GC0308_RUN(0, 0xdf, 2), 0x23, 0x09,
+	GC0308_RUN(0, 0xe2, 18),
+		0x00, 0x96, 0x02, 0x58, 0x02, 0x58, 0x02, 0x58,
+		0x0e, 0xa6, 0x20, 0x04, 0xa0, 0x40, 0x02, 0x01,
+		0x02, 0x30,
+	GC0308_RUN(0, 0xf7, 4), 0x12, 0x0a, 0x9f, 0x78,
+	/* page 1 */
+	GC0308_RUN(1, 0x00, 1), 0xf5,
+	GC0308_RUN(1, 0x02, 1), 0x20,
+	GC0308_RUN(1, 0x04, 3), 0x10, 0x08, 0x20,
+	GC0308_RUN(1, 0x08, 1), 0x0a,
+	GC0308_RUN(1, 0x0a, 3), 0xa0, 0x60, 0x08,
+	GC0308_RUN(1, 0x0e, 14),
+		0x44, 0x32, 0x41, 0x37, 0x22, 0x19, 0x44, 0x44,
+		0xc2, 0xa8, 0x18, 0x50, 0xd8, 0xf5,
+	GC0308_RUN(1, 0x30, 24),
+		0x03, 0x40, 0x10, 0xe0, 0xe0, 0x00, 0x80, 0x00,
+		0x04, 0x09, 0x12, 0x1c, 0x28, 0x31, 0x44, 0x57,
+		0x6c, 0x81, 0x94, 0xa7, 0xb8, 0xd6, 0xee, 0x0d,
+	GC0308_RUN(1, 0x62, 5), 0xf7, 0x68, 0xd3, 0xd3, 0x60,
+	GC0308_RUN(1, 0x70, 6), 0x40, 0x58, 0x30, 0x48, 0x20, 0x60,
+	GC0308_RUN(1, 0x77, 2), 0x20, 0x32,
+	GC0308_PROG_END,
+};
+
+/*
+ * Output size setup. The array always reads out the full 640x488 window;
+ * smaller sizes are produced on the sensor by the page 1 subsampler
+ * (0x54: row/column ratio) and the page 0 output crop window (0x46-0x4c),
+ * so only the final frame goes over the bus.
+ */
+static const u8 gc0308_setting_VGA_640_480[] = {
+	/* page 0 */
+	GC0308_RUN(0, 0x46, 1), 0x00,
+	/* page 1 */
+	GC0308_RUN(1, 0x53, 7), 0x82, 0x11, 0x03, 0x00, 0x00, 0x00, 0x00,
+	GC0308_PROG_END,
+};
+
+static const u8 gc0308_setting_QVGA_320_240[] = {
+	/* page 0 */
+	GC0308_RUN(0, 0x46, 7), 0x80, 0x00, 0x00, 0x00, 0xf0, 0x01, 0x40,
+	/* page 1 */
+	GC0308_RUN(1, 0x53, 7), 0x82, 0x22, 0x03, 0x00, 0x00, 0x00, 0x00,
+	GC0308_PROG_END,
+};
+
+static const u8 gc0308_setting_QQVGA_160_120[] = {
+	/* page 0 */
+	GC0308_RUN(0, 0x46, 7), 0x80, 0x00, 0x00, 0x00, 0x78, 0x00, 0xa0,
+	/* page 1 */
+	GC0308_RUN(1, 0x53, 7), 0x82, 0x44, 0x03, 0x00, 0x00, 0x00, 0x00,
+	GC0308_PROG_END,
+};
+
+static const u8 gc0308_setting_CIF_352_288[] = {
+	/* page 0 */
+	GC0308_RUN(0, 0x46, 7), 0x80, 0x60, 0x90, 0x01, 0x20, 0x01, 0x60,
+	/* page 1 */
+	GC0308_RUN(1, 0x53, 7), 0x82, 0x11, 0x03, 0x00, 0x00, 0x00, 0x00,
+	GC0308_PROG_END,
+};
+
+#endif /* GC0308_SETTING_H */
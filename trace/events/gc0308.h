@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2012-2015 Freescale Semiconductor, Inc. All Rights Reserved.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM gc0308
+
+#if !defined(_TRACE_GC0308_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_GC0308_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+/*
+ * One I2C transfer as seen on the bus: page is the page selected at the
+ * time, so a page select shows up as a write of reg 0xfe.
+ */
+DECLARE_EVENT_CLASS(gc0308_reg_io,
+	TP_PROTO(struct device *dev, u8 page, u8 reg, const u8 *vals, int len,
+		 int ret, s64 duration_ns),
+	TP_ARGS(dev, page, reg, vals, len, ret, duration_ns),
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, page)
+		__field(u8, reg)
+		__field(int, len)
+		__field(int, ret)
+		__field(s64, duration_ns)
+		__dynamic_array(u8, vals, len)
+	),
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->page = page;
+		__entry->reg = reg;
+		__entry->len = len;
+		__entry->ret = ret;
+		__entry->duration_ns = duration_ns;
+		memcpy(__get_dynamic_array(vals), vals, len);
+	),
+	TP_printk("%s page=%u reg=0x%02x len=%d vals=%s ret=%d duration=%lldns",
+		  __get_str(dev), __entry->page, __entry->reg, __entry->len,
+		  __print_hex(__get_dynamic_array(vals), __entry->len),
+		  __entry->ret, __entry->duration_ns)
+);
+
+DEFINE_EVENT(gc0308_reg_io, gc0308_reg_read,
+	TP_PROTO(struct device *dev, u8 page, u8 reg, const u8 *vals, int len,
+		 int ret, s64 duration_ns),
+	TP_ARGS(dev, page, reg, vals, len, ret, duration_ns)
+);
+
+DEFINE_EVENT(gc0308_reg_io, gc0308_reg_write,
+	TP_PROTO(struct device *dev, u8 page, u8 reg, const u8 *vals, int len,
+		 int ret, s64 duration_ns),
+	TP_ARGS(dev, page, reg, vals, len, ret, duration_ns)
+);
+
+DECLARE_EVENT_CLASS(gc0308_power,
+	TP_PROTO(struct device *dev, int state),
+	TP_ARGS(dev, state),
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(int, state)
+	),
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->state = state;
+	),
+	TP_printk("%s state=%d", __get_str(dev), __entry->state)
+);
+
+/* VIDIOC_S_POWER, state is the requested on/off */
+DEFINE_EVENT(gc0308_power, gc0308_s_power,
+	TP_PROTO(struct device *dev, int state),
+	TP_ARGS(dev, state)
+);
+
+/* PWDN pin, state 1 powers the sensor down */
+DEFINE_EVENT(gc0308_power, gc0308_power_down,
+	TP_PROTO(struct device *dev, int state),
+	TP_ARGS(dev, state)
+);
+
+/* reset sequence, state 1 on entry and 0 once the sensor is out of reset */
+DEFINE_EVENT(gc0308_power, gc0308_reset,
+	TP_PROTO(struct device *dev, int state),
+	TP_ARGS(dev, state)
+);
+
+TRACE_EVENT(gc0308_download_start,
+	TP_PROTO(struct device *dev, const u8 *prog),
+	TP_ARGS(dev, prog),
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(const u8 *, prog)
+	),
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->prog = prog;
+	),
+	TP_printk("%s prog=%pS", __get_str(dev), __entry->prog)
+);
+
+/* written and skipped count registers, skipped ones were already set */
+TRACE_EVENT(gc0308_download_end,
+	TP_PROTO(struct device *dev, int written, int skipped, int ret),
+	TP_ARGS(dev, written, skipped, ret),
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(int, written)
+		__field(int, skipped)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->written = written;
+		__entry->skipped = skipped;
+		__entry->ret = ret;
+	),
+	TP_printk("%s written=%d skipped=%d ret=%d", __get_str(dev),
+		  __entry->written, __entry->skipped, __entry->ret)
+);
+
+/* the requested frame interval and the one that was programmed */
+TRACE_EVENT(gc0308_s_parm,
+	TP_PROTO(struct device *dev, u32 req_num, u32 req_den, u32 num,
+		 u32 den, int ret),
+	TP_ARGS(dev, req_num, req_den, num, den, ret),
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u32, req_num)
+		__field(u32, req_den)
+		__field(u32, num)
+		__field(u32, den)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->req_num = req_num;
+		__entry->req_den = req_den;
+		__entry->num = num;
+		__entry->den = den;
+		__entry->ret = ret;
+	),
+	TP_printk("%s requested=%u/%u set=%u/%u ret=%d", __get_str(dev),
+		  __entry->req_num, __entry->req_den, __entry->num,
+		  __entry->den, __entry->ret)
+);
+
+/* switched is set when the mode program was downloaded */
+TRACE_EVENT(gc0308_s_fmt,
+	TP_PROTO(struct device *dev, u32 code, u32 width, u32 height, int mode,
+		 bool switched, int ret),
+	TP_ARGS(dev, code, width, height, mode, switched, ret),
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u32, code)
+		__field(u32, width)
+		__field(u32, height)
+		__field(int, mode)
+		__field(bool, switched)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->code = code;
+		__entry->width = width;
+		__entry->height = height;
+		__entry->mode = mode;
+		__entry->switched = switched;
+		__entry->ret = ret;
+	),
+	TP_printk("%s code=0x%04x %ux%u mode=%d switched=%d ret=%d",
+		  __get_str(dev), __entry->code, __entry->width,
+		  __entry->height, __entry->mode, __entry->switched,
+		  __entry->ret)
+);
+
+#endif /* _TRACE_GC0308_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>